@@ -0,0 +1,106 @@
+// This file is part of PGM-index <https://github.com/gvinciguerra/PGM-index>.
+// Copyright (c) 2021 Giorgio Vinciguerra.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "benchmark.hpp"
+#include "args.hxx"
+#include "pgm/pgm_index.hpp"
+
+#include <functional>
+#include <utility>
+
+#define BUILD_CLASSES(K) pgm::PGMIndex<K, 16>, pgm::PGMIndex<K, 64>, pgm::PGMIndex<K, 256>
+
+template<typename Index, typename K>
+void benchmark_build(const std::string &dataset, const std::vector<K> &data, int max_threads) {
+    auto name = demangle(typeid(Index).name());
+    std::vector<int> thread_counts;
+    for (int threads = 1; threads < max_threads; threads *= 2)
+        thread_counts.push_back(threads);
+    thread_counts.push_back(max_threads);
+
+    for (auto threads : thread_counts) {
+#ifdef _OPENMP
+        omp_set_num_threads(threads);
+#endif
+        auto t0 = timer::now();
+        Index index(data.begin(), data.end());
+        auto t1 = timer::now();
+        auto build_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count();
+        auto keys_per_s = uint64_t(data.size() * 1e9 / std::max<uint64_t>(build_ns, 1));
+        std::cout << dataset << ",\"" << name << "\"," << threads << "," << build_ns / 1000000 << "," << keys_per_s
+                  << "," << index.segments_count() << std::endl;
+    }
+}
+
+int main(int argc, char **argv) {
+    using namespace args;
+    ArgumentParser p("Measures the build throughput of the PGM-index on synthetic data for increasing thread counts.");
+    p.helpParams.flagindent = 2;
+    p.helpParams.helpindent = 25;
+    p.helpParams.progindent = 0;
+    p.helpParams.descriptionindent = 0;
+
+    HelpFlag help(p, "help", "Display this help menu", {'h', "help"});
+    Flag verbose(p, "", "Verbose output", {'v', "verbose"});
+    ValueFlag<size_t> synthetic(p, "size", "Size of the synthetic data", {'s', "synthetic"}, 100000000);
+    ValueFlag<int> threads(p, "threads", "Maximum number of threads", {'t', "threads"}, omp_get_num_procs());
+
+    try {
+        p.ParseCLI(argc, argv);
+    }
+    catch (args::Help &) {
+        std::cout << p;
+        return 0;
+    }
+    catch (args::Error &e) {
+        std::cerr << e.what() << std::endl;
+        std::cerr << p;
+        return 1;
+    }
+
+    if (synthetic.Get() < 1000) {
+        std::cerr << "Argument to --" << synthetic.GetMatcher().GetLongOrAny().str() << " must be greater than 1000.";
+        return 1;
+    }
+
+    global_verbose = verbose.Get();
+    std::cout << "dataset,class_name,threads,build_ms,keys_per_s,segments" << std::endl;
+
+    auto n = synthetic.Get();
+    std::mt19937 generator(std::random_device{}());
+    auto gen = [&](auto distribution) {
+        std::vector<uint64_t> out(n);
+        std::generate(out.begin(), out.end(), [&] { return distribution(generator); });
+        std::sort(out.begin(), out.end());
+        return out;
+    };
+    std::vector<std::pair<std::string, std::function<std::vector<uint64_t>()>>> distributions = {
+        {"uniform_dense", std::bind(gen, std::uniform_int_distribution<uint64_t>(0, n * 1000))},
+        {"uniform_sparse", std::bind(gen, std::uniform_int_distribution<uint64_t>(0, n * n))},
+        {"binomial", std::bind(gen, std::binomial_distribution<uint64_t>(1ull << 50))},
+        {"geometric", std::bind(gen, std::geometric_distribution<uint64_t>(1e-10))},
+    };
+
+    OUT_VERBOSE("Generating " << to_metric(n) << " elements (8-byte keys)")
+    for (auto&[dataset, gen_data] : distributions) {
+        auto data = gen_data();
+        for_types<BUILD_CLASSES(uint64_t)>([&](auto t) {
+            using class_type = typename decltype(t)::type;
+            benchmark_build<class_type>(dataset, data, std::max(threads.Get(), 1));
+        });
+    }
+
+    return 0;
+}
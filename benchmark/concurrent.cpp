@@ -0,0 +1,134 @@
+// This file is part of PGM-index <https://github.com/gvinciguerra/PGM-index>.
+// Copyright (c) 2021 Giorgio Vinciguerra.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "benchmark.hpp"
+#include "args.hxx"
+#include "pgm/pgm_index_concurrent.hpp"
+#include "pgm/pgm_index_dynamic.hpp"
+
+#include <atomic>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * Runs @p readers threads calling @p read on random keys while the calling thread calls @p write on the keys of
+ * @p updates, and prints the throughput of both.
+ */
+template<typename Read, typename Write>
+void benchmark_readers(const std::string &class_name, const std::vector<uint64_t> &data,
+                       const std::vector<uint64_t> &updates, size_t readers, Read read, Write write) {
+    std::atomic<bool> done(false);
+    std::atomic<uint64_t> reads(0);
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < readers; ++t) {
+        threads.emplace_back([&, t] {
+            std::mt19937_64 generator(t);
+            uint64_t cnt = 0;
+            uint64_t local_reads = 0;
+            while (!done.load(std::memory_order_relaxed)) {
+                cnt += read(data[generator() % data.size()]);
+                ++local_reads;
+            }
+            reads += local_reads;
+            [[maybe_unused]] volatile auto tmp = cnt;
+        });
+    }
+
+    auto t0 = timer::now();
+    for (auto &k : updates)
+        write(k);
+    auto t1 = timer::now();
+    done = true;
+    for (auto &t : threads)
+        t.join();
+
+    auto seconds = std::chrono::duration<double>(t1 - t0).count();
+    std::cout << "\"" << class_name << "\"," << readers << "," << uint64_t(reads / seconds) << ","
+              << uint64_t(updates.size() / seconds) << std::endl;
+}
+
+int main(int argc, char **argv) {
+    using namespace args;
+    ArgumentParser p("Measures the throughput of concurrent lookups in the Dynamic PGM-index during insertions.");
+    p.helpParams.flagindent = 2;
+    p.helpParams.helpindent = 25;
+    p.helpParams.progindent = 0;
+    p.helpParams.descriptionindent = 0;
+
+    HelpFlag help(p, "help", "Display this help menu", {'h', "help"});
+    Flag verbose(p, "", "Verbose output", {'v', "verbose"});
+    ValueFlag<size_t> synthetic(p, "size", "Size of the synthetic data", {'s', "synthetic"}, 10000000);
+    ValueFlag<size_t> inserts(p, "size", "Number of insertions during the lookups", {'i', "inserts"}, 2000000);
+    ValueFlag<size_t> max_readers(p, "threads", "Maximum number of reader threads", {'t', "threads"},
+                                  std::max<size_t>(1, std::thread::hardware_concurrency() - 1));
+
+    try {
+        p.ParseCLI(argc, argv);
+    }
+    catch (args::Help &) {
+        std::cout << p;
+        return 0;
+    }
+    catch (args::Error &e) {
+        std::cerr << e.what() << std::endl;
+        std::cerr << p;
+        return 1;
+    }
+
+    if (synthetic.Get() < 1000) {
+        std::cerr << "Argument to --" << synthetic.GetMatcher().GetLongOrAny().str() << " must be greater than 1000.";
+        return 1;
+    }
+
+    global_verbose = verbose.Get();
+    std::cout << "class_name,readers,reads_per_second,inserts_per_second" << std::endl;
+
+    auto n = synthetic.Get();
+    std::mt19937_64 generator(42);
+    std::vector<uint64_t> data(n);
+    std::generate(data.begin(), data.end(), [&] { return generator() >> 1; });
+    std::sort(data.begin(), data.end());
+    data.erase(std::unique(data.begin(), data.end()), data.end());
+    std::vector<uint64_t> updates(inserts.Get());
+    std::generate(updates.begin(), updates.end(), [&] { return generator() >> 1; });
+
+    std::vector<std::pair<uint64_t, uint64_t>> pairs(data.size());
+    std::transform(data.begin(), data.end(), pairs.begin(), [](auto k) { return std::make_pair(k, k); });
+    OUT_VERBOSE("Generated " << to_metric(data.size()) << " elements and " << to_metric(updates.size())
+                             << " insertions (8-byte keys)")
+
+    for (size_t readers = 1; readers <= max_readers.Get(); readers *= 2) {
+        pgm::DynamicPGMIndex<uint64_t, uint64_t> dynamic(pairs.begin(), pairs.end());
+        std::shared_mutex mutex;
+        benchmark_readers("shared_mutex<pgm::DynamicPGMIndex>", data, updates, readers,
+                          [&](auto k) {
+                              std::shared_lock<std::shared_mutex> lock(mutex);
+                              return dynamic.find(k)->second;
+                          },
+                          [&](auto k) {
+                              std::unique_lock<std::shared_mutex> lock(mutex);
+                              dynamic.insert_or_assign(k, k);
+                          });
+
+        pgm::ConcurrentDynamicPGMIndex<uint64_t, uint64_t> concurrent(pairs.begin(), pairs.end());
+        benchmark_readers("pgm::ConcurrentDynamicPGMIndex", data, updates, readers,
+                          [&](auto k) { return concurrent.snapshot().find(k)->second; },
+                          [&](auto k) { concurrent.insert_or_assign(k, k); });
+    }
+
+    return 0;
+}
@@ -0,0 +1,106 @@
+// This file is part of PGM-index <https://github.com/gvinciguerra/PGM-index>.
+// Copyright (c) 2021 Giorgio Vinciguerra.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "benchmark.hpp"
+#include "args.hxx"
+#include "pgm/pgm_index_dynamic.hpp"
+
+#include <string>
+#include <vector>
+
+/**
+ * Inserts the given keys one at a time, so that they spread over many levels, and prints the time of the lookups of
+ * keys that are in the container (hits) and of keys that are not (misses).
+ */
+void benchmark_find(const std::string &dataset, const std::vector<uint64_t> &keys, const std::vector<uint64_t> &hits,
+                    const std::vector<uint64_t> &misses, uint8_t filter_bits) {
+    pgm::DynamicPGMIndex<uint64_t, uint64_t> index(8, 0, 0, filter_bits);
+    for (auto k : keys)
+        index.insert_or_assign(k, k);
+
+    auto print = [&](const char *query, const std::vector<uint64_t> &queries) {
+        auto t0 = timer::now();
+        uint64_t cnt = 0;
+        for (auto q : queries)
+            cnt += index.find(q) != index.end();
+        auto t1 = timer::now();
+        [[maybe_unused]] volatile auto tmp = cnt;
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count() / queries.size();
+        std::cout << dataset << "," << int(filter_bits) << "," << query << "," << ns << ","
+                  << index.index_size_in_bytes() << std::endl;
+    };
+    print("hit", hits);
+    print("miss", misses);
+}
+
+int main(int argc, char **argv) {
+    using namespace args;
+    ArgumentParser p("Compares the lookups in the Dynamic PGM-index with and without the Bloom filters on the levels.");
+    p.helpParams.flagindent = 2;
+    p.helpParams.helpindent = 25;
+    p.helpParams.progindent = 0;
+    p.helpParams.descriptionindent = 0;
+
+    HelpFlag help(p, "help", "Display this help menu", {'h', "help"});
+    Flag verbose(p, "", "Verbose output", {'v', "verbose"});
+    ValueFlag<size_t> synthetic(p, "size", "Size of the synthetic data", {'s', "synthetic"}, 20000000);
+    ValueFlag<size_t> lookups(p, "size", "Number of lookups of each kind", {'l', "lookups"}, 1000000);
+
+    try {
+        p.ParseCLI(argc, argv);
+    }
+    catch (args::Help &) {
+        std::cout << p;
+        return 0;
+    }
+    catch (args::Error &e) {
+        std::cerr << e.what() << std::endl;
+        std::cerr << p;
+        return 1;
+    }
+
+    if (synthetic.Get() < 1000) {
+        std::cerr << "Argument to --" << synthetic.GetMatcher().GetLongOrAny().str() << " must be greater than 1000.";
+        return 1;
+    }
+
+    global_verbose = verbose.Get();
+    std::cout << "dataset,filter_bits,query,query_ns,index_bytes" << std::endl;
+
+    // Even keys are inserted, odd keys are the misses
+    auto n = synthetic.Get();
+    std::mt19937_64 generator(42);
+    std::vector<std::pair<std::string, std::vector<uint64_t>>> datasets(2);
+    datasets[0].first = "uniform";
+    datasets[1].first = "sequential";
+    for (size_t i = 0; i < n; ++i) {
+        datasets[0].second.push_back(generator() & ~uint64_t(1));
+        datasets[1].second.push_back(2 * i);
+    }
+
+    OUT_VERBOSE("Generated " << to_metric(n) << " insertions (8-byte keys)")
+    for (auto &[dataset, keys] : datasets) {
+        std::vector<uint64_t> hits(lookups.Get());
+        std::vector<uint64_t> misses(lookups.Get());
+        for (size_t i = 0; i < hits.size(); ++i) {
+            hits[i] = keys[generator() % n];
+            misses[i] = keys[generator() % n] + 1;
+        }
+        for (uint8_t filter_bits : {0, 10, 16})
+            benchmark_find(dataset, keys, hits, misses, filter_bits);
+    }
+
+    return 0;
+}
@@ -0,0 +1,175 @@
+// This file is part of PGM-index <https://github.com/gvinciguerra/PGM-index>.
+// Copyright (c) 2021 Giorgio Vinciguerra.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "benchmark.hpp"
+#include "args.hxx"
+#include "pgm/pgm_index.hpp"
+#include "pgm/pgm_memory.hpp"
+#include "pgm/pgm_search.hpp"
+
+#include <functional>
+#include <utility>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/** Counts the data TLB misses of the calling thread, if the kernel allows it. */
+class TLBMissCounter {
+    int fd = -1;
+
+public:
+    TLBMissCounter() {
+#ifdef __linux__
+        perf_event_attr attr{};
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.size = sizeof(attr);
+        attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+            | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#endif
+    }
+
+    ~TLBMissCounter() {
+        if (fd != -1)
+            close(fd);
+    }
+
+    bool available() const { return fd != -1; }
+
+    template<typename F>
+    int64_t count(F f) {
+        if (fd == -1) {
+            f();
+            return -1;
+        }
+#ifdef __linux__
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        f();
+        ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+        int64_t value = 0;
+        if (read(fd, &value, sizeof(value)) != sizeof(value))
+            return -1;
+        return value;
+#endif
+    }
+};
+
+template<typename Index, typename Data, typename K>
+void benchmark_pages(const std::string &dataset, const std::string &pages, const Data &data, const Index &index,
+                     const std::vector<K> &queries, TLBMissCounter &counter) {
+    auto name = demangle(typeid(Index).name());
+    auto first = data.data();
+    auto last = data.data() + data.size();
+    uint64_t cnt = 0;
+    auto t0 = timer::now();
+    auto misses = counter.count([&] {
+        for (auto &q : queries)
+            cnt += std::distance(first, pgm::lower_bound(index, first, last, q));
+    });
+    auto t1 = timer::now();
+    [[maybe_unused]] volatile auto tmp = cnt;
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count() / queries.size();
+    std::cout << dataset << ",\"" << name << "\"," << pages << "," << ns << ","
+              << (misses < 0 ? -1. : double(misses) / queries.size()) << std::endl;
+}
+
+template<typename Index, typename K>
+void benchmark_huge_pages(const std::string &dataset, const std::vector<K> &data, const std::vector<K> &queries,
+                          TLBMissCounter &counter) {
+    Index index(data.begin(), data.end());
+    benchmark_pages(dataset, "base", data, index, queries, counter);
+
+    std::vector<K, pgm::HugePageAllocator<K>> huge_data(data.begin(), data.end());
+    auto huge_index = index;
+    pgm::use_huge_pages(huge_index);
+    benchmark_pages(dataset, "huge", huge_data, huge_index, queries, counter);
+
+    pgm::NumaReplicatedIndex<Index> replicated(index);
+    benchmark_pages(dataset, "huge_numa_local", huge_data, replicated.local(), queries, counter);
+}
+
+int main(int argc, char **argv) {
+    using namespace args;
+    ArgumentParser p("Compares the lookup time and the TLB misses of the PGM-index on base pages and on huge pages.");
+    p.helpParams.flagindent = 2;
+    p.helpParams.helpindent = 25;
+    p.helpParams.progindent = 0;
+    p.helpParams.descriptionindent = 0;
+
+    HelpFlag help(p, "help", "Display this help menu", {'h', "help"});
+    Flag verbose(p, "", "Verbose output", {'v', "verbose"});
+    ValueFlag<size_t> synthetic(p, "size", "Size of the synthetic data", {'s', "synthetic"}, 100000000);
+    ValueFlag<double> ratio(p, "ratio", "Lookup ratio of the random workload", {'r', "ratio"}, 0.333);
+
+    try {
+        p.ParseCLI(argc, argv);
+    }
+    catch (args::Help &) {
+        std::cout << p;
+        return 0;
+    }
+    catch (args::Error &e) {
+        std::cerr << e.what() << std::endl;
+        std::cerr << p;
+        return 1;
+    }
+
+    if (synthetic.Get() < 1000) {
+        std::cerr << "Argument to --" << synthetic.GetMatcher().GetLongOrAny().str() << " must be greater than 1000.";
+        return 1;
+    }
+
+    global_verbose = verbose.Get();
+    TLBMissCounter counter;
+    if (!counter.available())
+        std::cerr << "TLB misses are not available, check /proc/sys/kernel/perf_event_paranoid" << std::endl;
+    std::cout << "dataset,class_name,pages,query_ns,tlb_misses_per_query" << std::endl;
+
+    auto n = synthetic.Get();
+    std::mt19937 generator(std::random_device{}());
+    auto gen = [&](auto distribution) {
+        std::vector<uint64_t> out(n);
+        std::generate(out.begin(), out.end(), [&] { return distribution(generator); });
+        std::sort(out.begin(), out.end());
+        return out;
+    };
+    std::vector<std::pair<std::string, std::function<std::vector<uint64_t>()>>> distributions = {
+        {"uniform_dense", std::bind(gen, std::uniform_int_distribution<uint64_t>(0, n * 1000))},
+        {"uniform_sparse", std::bind(gen, std::uniform_int_distribution<uint64_t>(0, n * n))},
+        {"binomial", std::bind(gen, std::binomial_distribution<uint64_t>(1ull << 50))},
+        {"geometric", std::bind(gen, std::geometric_distribution<uint64_t>(1e-10))},
+    };
+
+    OUT_VERBOSE("Generating " << to_metric(n) << " elements (8-byte keys)")
+    for (auto&[dataset, gen_data] : distributions) {
+        auto data = gen_data();
+        auto queries = generate_queries(data.begin(), data.end(), ratio.Get());
+        OUT_VERBOSE("Generated " << to_metric(queries.size()) << " queries on " << dataset)
+        for_types<pgm::PGMIndex<uint64_t, 16>, pgm::PGMIndex<uint64_t, 64>>([&](auto t) {
+            using class_type = typename decltype(t)::type;
+            benchmark_huge_pages<class_type>(dataset, data, queries, counter);
+        });
+    }
+
+    return 0;
+}
@@ -0,0 +1,187 @@
+// This file is part of PGM-index <https://github.com/gvinciguerra/PGM-index>.
+// Copyright (c) 2021 Giorgio Vinciguerra.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "benchmark.hpp"
+#include "args.hxx"
+#include "pgm/pgm_coroutine.hpp"
+#include "pgm/pgm_index.hpp"
+#include "pgm/pgm_index_variants.hpp"
+#include "pgm/pgm_search.hpp"
+
+#include <cstdio>
+#include <functional>
+#include <utility>
+
+#ifdef PGM_COROUTINES_ENABLED
+
+#define INTERLEAVED_CLASSES(K) pgm::PGMIndex<K, 16>, pgm::PGMIndex<K, 64>, \
+                               pgm::PGMIndex<K, 64, 4, float, pgm::SplitLayout>
+
+template<typename F>
+uint64_t time_per_query_ns(size_t num_queries, F f) {
+    auto t0 = timer::now();
+    f();
+    auto t1 = timer::now();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count() / num_queries;
+}
+
+template<typename Index, typename K>
+void benchmark_interleaved(const std::string &dataset, const std::vector<K> &data, const std::vector<K> &queries,
+                           const std::vector<size_t> &in_flight_counts) {
+    Index index(data.begin(), data.end());
+    auto name = demangle(typeid(Index).name());
+    auto print = [&](const char *method, size_t in_flight, uint64_t ns) {
+        std::cout << dataset << ",\"" << name << "\"," << method << "," << in_flight << "," << ns << std::endl;
+    };
+
+    print("search", 1, time_per_query_ns(queries.size(), [&] {
+        uint64_t cnt = 0;
+        for (auto &q : queries)
+            cnt += index.search(q).pos;
+        [[maybe_unused]] volatile auto tmp = cnt;
+    }));
+
+    print("pgm::lower_bound", 1, time_per_query_ns(queries.size(), [&] {
+        uint64_t cnt = 0;
+        for (auto &q : queries)
+            cnt += std::distance(data.begin(), pgm::lower_bound(index, data, q));
+        [[maybe_unused]] volatile auto tmp = cnt;
+    }));
+
+    for (auto in_flight : in_flight_counts) {
+        print("search_task", in_flight, time_per_query_ns(queries.size(), [&] {
+            uint64_t cnt = 0;
+            pgm::run_interleaved(queries.size(), in_flight,
+                                 [&](size_t i) { return pgm::search_task(index, queries[i]); },
+                                 [&](size_t, const pgm::ApproxPos &p) { cnt += p.pos; });
+            [[maybe_unused]] volatile auto tmp = cnt;
+        }));
+
+        print("lower_bound_task", in_flight, time_per_query_ns(queries.size(), [&] {
+            uint64_t cnt = 0;
+            auto make = [&](size_t i) { return pgm::lower_bound_task(index, data.begin(), data.end(), queries[i]); };
+            pgm::run_interleaved(queries.size(), in_flight, make,
+                                 [&](size_t, auto it) { cnt += std::distance(data.begin(), it); });
+            [[maybe_unused]] volatile auto tmp = cnt;
+        }));
+    }
+}
+
+template<typename K>
+void benchmark_mapped(const std::string &dataset, const std::vector<K> &data, const std::vector<K> &queries,
+                      const std::vector<size_t> &in_flight_counts) {
+    std::string tmp_filename = "tmp.benchmark.pgm";
+    pgm::MappedPGMIndex<K, 64> index(data.begin(), data.end(), tmp_filename);
+    auto print = [&](const char *method, size_t in_flight, uint64_t ns) {
+        std::cout << dataset << ",\"pgm::MappedPGMIndex<64>\"," << method << "," << in_flight << "," << ns << std::endl;
+    };
+
+    print("lower_bound", 1, time_per_query_ns(queries.size(), [&] {
+        uint64_t cnt = 0;
+        for (auto &q : queries)
+            cnt += std::distance(index.begin(), index.lower_bound(q));
+        [[maybe_unused]] volatile auto tmp = cnt;
+    }));
+
+    for (auto in_flight : in_flight_counts) {
+        print("lower_bound_task", in_flight, time_per_query_ns(queries.size(), [&] {
+            uint64_t cnt = 0;
+            pgm::run_interleaved(queries.size(), in_flight,
+                                 [&](size_t i) { return pgm::lower_bound_task(index, queries[i]); },
+                                 [&](size_t, auto it) { cnt += std::distance(index.begin(), it); });
+            [[maybe_unused]] volatile auto tmp = cnt;
+        }));
+    }
+
+    std::remove(tmp_filename.c_str());
+}
+
+int main(int argc, char **argv) {
+    using namespace args;
+    ArgumentParser p("Measures the throughput of interleaved coroutine lookups for an increasing number of lookups "
+                     "in flight.");
+    p.helpParams.flagindent = 2;
+    p.helpParams.helpindent = 25;
+    p.helpParams.progindent = 0;
+    p.helpParams.descriptionindent = 0;
+
+    HelpFlag help(p, "help", "Display this help menu", {'h', "help"});
+    Flag verbose(p, "", "Verbose output", {'v', "verbose"});
+    ValueFlag<size_t> synthetic(p, "size", "Size of the synthetic data", {'s', "synthetic"}, 100000000);
+    ValueFlag<size_t> max_in_flight(p, "count", "Maximum number of lookups in flight", {'f', "in-flight"}, 64);
+    ValueFlag<double> ratio(p, "ratio", "Lookup ratio of the random workload", {'r', "ratio"}, 0.333);
+
+    try {
+        p.ParseCLI(argc, argv);
+    }
+    catch (args::Help &) {
+        std::cout << p;
+        return 0;
+    }
+    catch (args::Error &e) {
+        std::cerr << e.what() << std::endl;
+        std::cerr << p;
+        return 1;
+    }
+
+    if (synthetic.Get() < 1000) {
+        std::cerr << "Argument to --" << synthetic.GetMatcher().GetLongOrAny().str() << " must be greater than 1000.";
+        return 1;
+    }
+
+    global_verbose = verbose.Get();
+    std::cout << "dataset,class_name,method,in_flight,query_ns" << std::endl;
+
+    std::vector<size_t> in_flight_counts;
+    for (size_t f = 1; f < max_in_flight.Get(); f *= 2)
+        in_flight_counts.push_back(f);
+    in_flight_counts.push_back(std::max<size_t>(max_in_flight.Get(), 1));
+
+    auto n = synthetic.Get();
+    std::mt19937 generator(std::random_device{}());
+    auto gen = [&](auto distribution) {
+        std::vector<uint64_t> out(n);
+        std::generate(out.begin(), out.end(), [&] { return distribution(generator); });
+        std::sort(out.begin(), out.end());
+        return out;
+    };
+    std::vector<std::pair<std::string, std::function<std::vector<uint64_t>()>>> distributions = {
+        {"uniform_dense", std::bind(gen, std::uniform_int_distribution<uint64_t>(0, n * 1000))},
+        {"uniform_sparse", std::bind(gen, std::uniform_int_distribution<uint64_t>(0, n * n))},
+    };
+
+    OUT_VERBOSE("Generating " << to_metric(n) << " elements (8-byte keys)")
+    for (auto&[dataset, gen_data] : distributions) {
+        auto data = gen_data();
+        auto queries = generate_queries(data.begin(), data.end(), ratio.Get());
+        OUT_VERBOSE("Generated " << to_metric(queries.size()) << " queries on " << dataset)
+        for_types<INTERLEAVED_CLASSES(uint64_t)>([&](auto t) {
+            using class_type = typename decltype(t)::type;
+            benchmark_interleaved<class_type>(dataset, data, queries, in_flight_counts);
+        });
+        benchmark_mapped(dataset, data, queries, in_flight_counts);
+    }
+
+    return 0;
+}
+
+#else
+
+int main() {
+    std::cerr << "This benchmark requires a compiler with support for C++20 coroutines." << std::endl;
+    return 1;
+}
+
+#endif
@@ -0,0 +1,235 @@
+// This file is part of PGM-index <https://github.com/gvinciguerra/PGM-index>.
+// Copyright (c) 2021 Giorgio Vinciguerra.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "benchmark.hpp"
+#include "args.hxx"
+#include "pgm/pgm_index.hpp"
+#include "pgm/pgm_index_variants.hpp"
+#include "pgm/pgm_search.hpp"
+
+#include <functional>
+#include <limits>
+#include <string>
+#include <utility>
+
+#define FOR_EACH_LAYOUT(K, E) pgm::PGMIndex<K, E>, pgm::PGMIndex<K, E, 4, float, pgm::SplitLayout>
+#define FOR_EACH_VARIANT(K, E) FOR_EACH_LAYOUT(K, E), pgm::TightPGMIndex<K, E>
+#define LOOKUP_CLASSES(K) FOR_EACH_VARIANT(K, 16), FOR_EACH_VARIANT(K, 64), FOR_EACH_VARIANT(K, 256)
+
+template<typename F>
+uint64_t time_per_query_ns(size_t num_queries, F f) {
+    auto t0 = timer::now();
+    f();
+    auto t1 = timer::now();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count() / num_queries;
+}
+
+template<typename Index, typename K>
+void benchmark_lookup_methods(const std::string &dataset, const std::vector<K> &data, const std::vector<K> &queries) {
+    Index index(data.begin(), data.end());
+    auto name = demangle(typeid(Index).name());
+    double window = 0;
+    for (auto &q : queries) {
+        auto range = index.search(q);
+        window += range.hi - range.lo;
+    }
+    window /= queries.size();
+    auto print = [&](const char *method, uint64_t ns) {
+        std::cout << dataset << ",\"" << name << "\"," << method << "," << ns << "," << window << ","
+                  << index.size_in_bytes() << std::endl;
+    };
+
+    print("search", time_per_query_ns(queries.size(), [&] {
+        uint64_t cnt = 0;
+        for (auto &q : queries)
+            cnt += index.search(q).pos;
+        [[maybe_unused]] volatile auto tmp = cnt;
+    }));
+
+    std::vector<pgm::ApproxPos> results(queries.size());
+    print("search_batch", time_per_query_ns(queries.size(), [&] {
+        index.search_batch(queries.data(), queries.size(), results.data());
+        uint64_t cnt = 0;
+        for (auto &r : results)
+            cnt += r.pos;
+        [[maybe_unused]] volatile auto tmp = cnt;
+    }));
+
+    print("search+std::lower_bound", time_per_query_ns(queries.size(), [&] {
+        uint64_t cnt = 0;
+        for (auto &q : queries) {
+            auto range = index.search(q);
+            cnt += std::distance(data.begin(), std::lower_bound(data.begin() + range.lo, data.begin() + range.hi, q));
+        }
+        [[maybe_unused]] volatile auto tmp = cnt;
+    }));
+
+    print("pgm::lower_bound", time_per_query_ns(queries.size(), [&] {
+        uint64_t cnt = 0;
+        for (auto &q : queries)
+            cnt += std::distance(data.begin(), pgm::lower_bound(index, data, q));
+        [[maybe_unused]] volatile auto tmp = cnt;
+    }));
+}
+
+#define LAST_MILE_POLICIES pgm::BinarySearch, pgm::BranchlessBinarySearch, pgm::ExponentialSearch, \
+    pgm::InterpolationSearch, pgm::LinearSearch, pgm::AdaptiveSearch
+
+template<typename K, size_t Epsilon>
+void benchmark_last_mile(const std::string &dataset, const std::vector<K> &data, const std::vector<K> &queries) {
+    pgm::PGMIndex<K, Epsilon> index(data.begin(), data.end());
+    auto name = demangle(typeid(index).name());
+    std::string best_policy;
+    uint64_t best_ns = std::numeric_limits<uint64_t>::max();
+
+    for_types<LAST_MILE_POLICIES>([&](auto t) {
+        using policy_type = typename decltype(t)::type;
+        auto method = "pgm::lower_bound<" + demangle(typeid(policy_type).name()) + ">";
+        auto ns = time_per_query_ns(queries.size(), [&] {
+            uint64_t cnt = 0;
+            for (auto &q : queries)
+                cnt += std::distance(data.begin(), pgm::lower_bound<policy_type>(index, data, q));
+            [[maybe_unused]] volatile auto tmp = cnt;
+        });
+        std::cout << dataset << ",\"" << name << "\"," << method << "," << ns << ",," << std::endl;
+        if (ns < best_ns) {
+            best_ns = ns;
+            best_policy = method;
+        }
+    });
+
+    std::cerr << "Fastest last-mile search on " << dataset << " with epsilon " << Epsilon << ": " << best_policy
+              << " (" << best_ns << " ns/query)" << std::endl;
+}
+
+template<typename K, size_t Epsilon, size_t Height = 1>
+void benchmark_fixed_height(const std::string &dataset, const std::vector<K> &data, const std::vector<K> &queries) {
+    if constexpr (Height <= 8) {
+        if (pgm::PGMIndex<K, Epsilon>(data.begin(), data.end()).height() != Height)
+            return benchmark_fixed_height<K, Epsilon, Height + 1>(dataset, data, queries);
+        benchmark_lookup_methods<pgm::FixedHeightPGMIndex<K, Epsilon, Height>>(dataset, data, queries);
+    }
+}
+
+void benchmark_string_lookup(size_t n) {
+    std::mt19937_64 generator(42);
+    auto alphanumeric = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz";
+    std::vector<std::string> data(n);
+    for (auto &s : data) {
+        s = "SHN";
+        while (s.size() < 12)
+            s += alphanumeric[generator() % 62];
+    }
+    std::sort(data.begin(), data.end());
+
+    std::vector<std::string> queries(std::min<size_t>(n, 1000000));
+    for (size_t i = 0; i < queries.size(); ++i)
+        queries[i] = i % 2 ? data[generator() % n] : data[generator() % n] + alphanumeric[generator() % 62];
+
+    auto print = [&](const char *class_name, const char *method, uint64_t ns) {
+        std::cout << "shn_strings,\"" << class_name << "\"," << method << "," << ns << ",," << std::endl;
+    };
+
+    print("std::vector<std::string>", "std::lower_bound", time_per_query_ns(queries.size(), [&] {
+        uint64_t cnt = 0;
+        for (auto &q : queries)
+            cnt += std::distance(data.begin(), std::lower_bound(data.begin(), data.end(), q));
+        [[maybe_unused]] volatile auto tmp = cnt;
+    }));
+
+    auto benchmark_index = [&](const char *class_name, const auto &index) {
+        print(class_name, "lower_bound", time_per_query_ns(queries.size(), [&] {
+            uint64_t cnt = 0;
+            for (auto &q : queries)
+                cnt += index.lower_bound(q);
+            [[maybe_unused]] volatile auto tmp = cnt;
+        }));
+    };
+    benchmark_index("pgm::StringPGMIndex<16>", pgm::StringPGMIndex<16>(data.begin(), data.end()));
+    benchmark_index("pgm::StringPGMIndex<64>", pgm::StringPGMIndex<64>(data.begin(), data.end()));
+}
+
+int main(int argc, char **argv) {
+    using namespace args;
+    ArgumentParser p("Compares the lookup methods of the PGM-index on synthetic data.");
+    p.helpParams.flagindent = 2;
+    p.helpParams.helpindent = 25;
+    p.helpParams.progindent = 0;
+    p.helpParams.descriptionindent = 0;
+
+    HelpFlag help(p, "help", "Display this help menu", {'h', "help"});
+    Flag verbose(p, "", "Verbose output", {'v', "verbose"});
+    ValueFlag<size_t> synthetic(p, "size", "Size of the synthetic data", {'s', "synthetic"}, 100000000);
+    ValueFlag<double> ratio(p, "ratio", "Lookup ratio of the random workload", {'r', "ratio"}, 0.333);
+    ValueFlag<size_t> strings(p, "size", "Size of the SHN-style string data", {"strings"}, 1000000);
+
+    try {
+        p.ParseCLI(argc, argv);
+    }
+    catch (args::Help &) {
+        std::cout << p;
+        return 0;
+    }
+    catch (args::Error &e) {
+        std::cerr << e.what() << std::endl;
+        std::cerr << p;
+        return 1;
+    }
+
+    if (synthetic.Get() < 1000) {
+        std::cerr << "Argument to --" << synthetic.GetMatcher().GetLongOrAny().str() << " must be greater than 1000.";
+        return 1;
+    }
+
+    global_verbose = verbose.Get();
+    std::cout << "dataset,class_name,method,query_ns,avg_window,index_bytes" << std::endl;
+
+    auto n = synthetic.Get();
+    std::mt19937 generator(std::random_device{}());
+    auto gen = [&](auto distribution) {
+        std::vector<uint64_t> out(n);
+        std::generate(out.begin(), out.end(), [&] { return distribution(generator); });
+        std::sort(out.begin(), out.end());
+        return out;
+    };
+    std::vector<std::pair<std::string, std::function<std::vector<uint64_t>()>>> distributions = {
+        {"uniform_dense", std::bind(gen, std::uniform_int_distribution<uint64_t>(0, n * 1000))},
+        {"uniform_sparse", std::bind(gen, std::uniform_int_distribution<uint64_t>(0, n * n))},
+        {"binomial", std::bind(gen, std::binomial_distribution<uint64_t>(1ull << 50))},
+        {"geometric", std::bind(gen, std::geometric_distribution<uint64_t>(1e-10))},
+    };
+
+    OUT_VERBOSE("Generating " << to_metric(n) << " elements (8-byte keys)")
+    for (auto&[dataset, gen_data] : distributions) {
+        auto data = gen_data();
+        auto queries = generate_queries(data.begin(), data.end(), ratio.Get());
+        OUT_VERBOSE("Generated " << to_metric(queries.size()) << " queries on " << dataset)
+        for_types<LOOKUP_CLASSES(uint64_t)>([&](auto t) {
+            using class_type = typename decltype(t)::type;
+            benchmark_lookup_methods<class_type>(dataset, data, queries);
+        });
+        benchmark_fixed_height<uint64_t, 16>(dataset, data, queries);
+        benchmark_fixed_height<uint64_t, 64>(dataset, data, queries);
+        benchmark_fixed_height<uint64_t, 256>(dataset, data, queries);
+        benchmark_last_mile<uint64_t, 16>(dataset, data, queries);
+        benchmark_last_mile<uint64_t, 64>(dataset, data, queries);
+        benchmark_last_mile<uint64_t, 256>(dataset, data, queries);
+    }
+
+    OUT_VERBOSE("Generating " << to_metric(strings.Get()) << " SHN-style strings")
+    benchmark_string_lookup(strings.Get());
+
+    return 0;
+}
@@ -0,0 +1,138 @@
+// This file is part of PGM-index <https://github.com/gvinciguerra/PGM-index>.
+// Copyright (c) 2021 Giorgio Vinciguerra.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "benchmark.hpp"
+#include "args.hxx"
+#include "pgm/pgm_index_dynamic.hpp"
+
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * Inserts the given keys one at a time, so that they spread over many levels, and prints the time per element of the
+ * scans of @p scan_size elements done with range, with the cursor one element at a time, and with the cursor in chunks.
+ */
+void benchmark_scan(const std::string &dataset, const std::vector<uint64_t> &keys, size_t scan_size, size_t scans) {
+    pgm::DynamicPGMIndex<uint64_t, uint64_t> index;
+    for (size_t i = 0; i < keys.size(); ++i)
+        index.insert_or_assign(keys[i], i);
+
+    auto sorted = keys;
+    std::sort(sorted.begin(), sorted.end());
+    sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+    std::mt19937_64 generator(42);
+    std::vector<std::pair<uint64_t, uint64_t>> bounds(scans);
+    for (auto &[lo, hi] : bounds) {
+        auto first = generator() % (sorted.size() - scan_size);
+        lo = sorted[first];
+        hi = sorted[first + scan_size - 1];
+    }
+
+    auto print = [&](const char *method, auto scan) {
+        uint64_t sum = 0;
+        auto t0 = timer::now();
+        for (auto[lo, hi] : bounds)
+            sum += scan(lo, hi);
+        auto t1 = timer::now();
+        [[maybe_unused]] volatile auto tmp = sum;
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count();
+        std::cout << dataset << "," << method << "," << scan_size << "," << double(ns) / (scans * scan_size)
+                  << std::endl;
+    };
+
+    print("range", [&](auto lo, auto hi) {
+        uint64_t sum = 0;
+        for (auto &[k, v] : index.range(lo, hi))
+            sum += v;
+        return sum;
+    });
+
+    auto cursor = index.range_cursor(0, 0);
+    print("range_cursor", [&](auto lo, auto hi) {
+        uint64_t sum = 0;
+        cursor.seek(lo, hi);
+        while (auto item = cursor.next())
+            sum += item->second;
+        return sum;
+    });
+
+    std::vector<std::pair<uint64_t, uint64_t>> chunk(256);
+    print("range_cursor_chunks", [&](auto lo, auto hi) {
+        uint64_t sum = 0;
+        cursor.seek(lo, hi);
+        for (size_t n; (n = cursor.next_chunk(chunk.data(), chunk.size())) != 0;)
+            for (size_t i = 0; i < n; ++i)
+                sum += chunk[i].second;
+        return sum;
+    });
+}
+
+int main(int argc, char **argv) {
+    using namespace args;
+    ArgumentParser p("Compares the range scans of the Dynamic PGM-index that copy the result with the range cursor.");
+    p.helpParams.flagindent = 2;
+    p.helpParams.helpindent = 25;
+    p.helpParams.progindent = 0;
+    p.helpParams.descriptionindent = 0;
+
+    HelpFlag help(p, "help", "Display this help menu", {'h', "help"});
+    Flag verbose(p, "", "Verbose output", {'v', "verbose"});
+    ValueFlag<size_t> synthetic(p, "size", "Size of the synthetic data", {'s', "synthetic"}, 20000000);
+    ValueFlagList<size_t> sizes(p, "size", "Number of elements of each scan (repeatable)", {'r', "range"},
+                                {100, 10000, 1000000});
+    ValueFlag<size_t> scans(p, "count", "Number of scans of each size", {'c', "count"}, 10);
+
+    try {
+        p.ParseCLI(argc, argv);
+    }
+    catch (args::Help &) {
+        std::cout << p;
+        return 0;
+    }
+    catch (args::Error &e) {
+        std::cerr << e.what() << std::endl;
+        std::cerr << p;
+        return 1;
+    }
+
+    if (synthetic.Get() < 1000) {
+        std::cerr << "Argument to --" << synthetic.GetMatcher().GetLongOrAny().str() << " must be greater than 1000.";
+        return 1;
+    }
+
+    global_verbose = verbose.Get();
+    std::cout << "dataset,method,scan_size,ns_per_element" << std::endl;
+
+    auto n = synthetic.Get();
+    std::mt19937_64 generator(42);
+    std::vector<std::pair<std::string, std::vector<uint64_t>>> datasets(2);
+    datasets[0].first = "uniform";
+    datasets[1].first = "sequential";
+    for (size_t i = 0; i < n; ++i) {
+        datasets[0].second.push_back(generator());
+        datasets[1].second.push_back(i);
+    }
+
+    OUT_VERBOSE("Generated " << to_metric(n) << " insertions (8-byte keys)")
+    for (auto &[dataset, keys] : datasets) {
+        for (auto size : sizes.Get())
+            if (size > 0 && size < n / 2)
+                benchmark_scan(dataset, keys, size, std::max<size_t>(scans.Get(), 1));
+    }
+
+    return 0;
+}
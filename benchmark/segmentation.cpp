@@ -0,0 +1,93 @@
+// This file is part of PGM-index <https://github.com/gvinciguerra/PGM-index>.
+// Copyright (c) 2021 Giorgio Vinciguerra.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "benchmark.hpp"
+#include "args.hxx"
+#include "pgm/piecewise_linear_model.hpp"
+
+#include <functional>
+#include <utility>
+
+template<typename K>
+void benchmark_segmentation(const std::string &dataset, const std::vector<K> &data, size_t epsilon) {
+    using pair_type = std::pair<K, size_t>;
+    auto in_fun = [&](auto i) { return pair_type(data[i], i); };
+    size_t segments = 0;
+    auto out_fun = [&](const auto &) { ++segments; };
+
+    auto t0 = timer::now();
+    pgm::internal::make_segmentation(data.size(), epsilon, in_fun, out_fun);
+    auto t1 = timer::now();
+    auto ns = std::chrono::duration<double, std::nano>(t1 - t0).count() / data.size();
+    std::cout << dataset << "," << epsilon << "," << ns << "," << segments << std::endl;
+}
+
+int main(int argc, char **argv) {
+    using namespace args;
+    ArgumentParser p("Measures the speed of the segmentation algorithm of the PGM-index on synthetic data.");
+    p.helpParams.flagindent = 2;
+    p.helpParams.helpindent = 25;
+    p.helpParams.progindent = 0;
+    p.helpParams.descriptionindent = 0;
+
+    HelpFlag help(p, "help", "Display this help menu", {'h', "help"});
+    Flag verbose(p, "", "Verbose output", {'v', "verbose"});
+    ValueFlag<size_t> synthetic(p, "size", "Size of the synthetic data", {'s', "synthetic"}, 100000000);
+
+    try {
+        p.ParseCLI(argc, argv);
+    }
+    catch (args::Help &) {
+        std::cout << p;
+        return 0;
+    }
+    catch (args::Error &e) {
+        std::cerr << e.what() << std::endl;
+        std::cerr << p;
+        return 1;
+    }
+
+    if (synthetic.Get() < 1000) {
+        std::cerr << "Argument to --" << synthetic.GetMatcher().GetLongOrAny().str() << " must be greater than 1000.";
+        return 1;
+    }
+
+    global_verbose = verbose.Get();
+    std::cout << "dataset,epsilon,ns_per_key,segments" << std::endl;
+
+    auto n = synthetic.Get();
+    std::mt19937 generator(42);
+    auto gen = [&](auto distribution) {
+        std::vector<uint64_t> out(n);
+        std::generate(out.begin(), out.end(), [&] { return distribution(generator); });
+        std::sort(out.begin(), out.end());
+        return out;
+    };
+    std::vector<std::pair<std::string, std::function<std::vector<uint64_t>()>>> distributions = {
+        {"uniform_dense", std::bind(gen, std::uniform_int_distribution<uint64_t>(0, n * 1000))},
+        {"uniform_sparse", std::bind(gen, std::uniform_int_distribution<uint64_t>(0, n * n))},
+        {"binomial", std::bind(gen, std::binomial_distribution<uint64_t>(1ull << 50))},
+        {"negative_binomial", std::bind(gen, std::negative_binomial_distribution<uint64_t>(1ull << 50, 0.3))},
+        {"geometric", std::bind(gen, std::geometric_distribution<uint64_t>(1e-10))},
+    };
+
+    OUT_VERBOSE("Generating " << to_metric(n) << " elements (8-byte keys)")
+    for (auto&[dataset, gen_data] : distributions) {
+        auto data = gen_data();
+        for (auto epsilon : {16, 64, 256})
+            benchmark_segmentation(dataset, data, epsilon);
+    }
+
+    return 0;
+}
@@ -0,0 +1,131 @@
+// This file is part of PGM-index <https://github.com/gvinciguerra/PGM-index>.
+// Copyright (c) 2021 Giorgio Vinciguerra.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "benchmark.hpp"
+#include "args.hxx"
+#include "pgm/pgm_index.hpp"
+#include "pgm/pgm_search.hpp"
+
+#include <functional>
+#include <utility>
+
+#define FOR_EACH_SLOPE(K, E) pgm::PGMIndex<K, E, 4, float>, pgm::PGMIndex<K, E, 4, double>, \
+    pgm::PGMIndex<K, E, 4, pgm::FixedPointSlope<uint32_t>>, pgm::PGMIndex<K, E, 4, pgm::FixedPointSlope<uint64_t>>
+#define SLOPE_CLASSES(K) FOR_EACH_SLOPE(K, 16), FOR_EACH_SLOPE(K, 64), FOR_EACH_SLOPE(K, 256)
+
+template<typename F>
+uint64_t time_per_query_ns(size_t num_queries, F f) {
+    auto t0 = timer::now();
+    f();
+    auto t1 = timer::now();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count() / num_queries;
+}
+
+template<typename Index, typename K>
+void benchmark_slope(const std::string &dataset, const std::vector<K> &data, const std::vector<K> &queries) {
+    Index index(data.begin(), data.end());
+    auto name = demangle(typeid(Index).name());
+
+    double avg_error = 0;
+    size_t max_error = 0;
+    for (size_t i = 0; i < data.size(); i += 97) {
+        auto first = std::distance(data.begin(), std::lower_bound(data.begin(), data.begin() + i, data[i]));
+        auto pos = index.search(data[i]).pos;
+        auto error = pos > size_t(first) ? pos - first : first - pos;
+        avg_error += error;
+        max_error = std::max(max_error, error);
+    }
+    avg_error /= (data.size() + 96) / 97;
+
+    auto search_ns = time_per_query_ns(queries.size(), [&] {
+        uint64_t cnt = 0;
+        for (auto &q : queries)
+            cnt += index.search(q).pos;
+        [[maybe_unused]] volatile auto tmp = cnt;
+    });
+
+    auto lower_bound_ns = time_per_query_ns(queries.size(), [&] {
+        uint64_t cnt = 0;
+        for (auto &q : queries)
+            cnt += std::distance(data.begin(), pgm::lower_bound(index, data, q));
+        [[maybe_unused]] volatile auto tmp = cnt;
+    });
+
+    std::cout << dataset << ",\"" << name << "\"," << search_ns << "," << lower_bound_ns << "," << avg_error << ","
+              << max_error << "," << index.size_in_bytes() << std::endl;
+}
+
+int main(int argc, char **argv) {
+    using namespace args;
+    ArgumentParser p("Compares floating-point and fixed-point slopes in the PGM-index on synthetic data.");
+    p.helpParams.flagindent = 2;
+    p.helpParams.helpindent = 25;
+    p.helpParams.progindent = 0;
+    p.helpParams.descriptionindent = 0;
+
+    HelpFlag help(p, "help", "Display this help menu", {'h', "help"});
+    Flag verbose(p, "", "Verbose output", {'v', "verbose"});
+    ValueFlag<size_t> synthetic(p, "size", "Size of the synthetic data", {'s', "synthetic"}, 100000000);
+    ValueFlag<double> ratio(p, "ratio", "Lookup ratio of the random workload", {'r', "ratio"}, 0.333);
+
+    try {
+        p.ParseCLI(argc, argv);
+    }
+    catch (args::Help &) {
+        std::cout << p;
+        return 0;
+    }
+    catch (args::Error &e) {
+        std::cerr << e.what() << std::endl;
+        std::cerr << p;
+        return 1;
+    }
+
+    if (synthetic.Get() < 1000) {
+        std::cerr << "Argument to --" << synthetic.GetMatcher().GetLongOrAny().str() << " must be greater than 1000.";
+        return 1;
+    }
+
+    global_verbose = verbose.Get();
+    std::cout << "dataset,class_name,search_ns,lower_bound_ns,avg_error,max_error,index_bytes" << std::endl;
+
+    auto n = synthetic.Get();
+    std::mt19937 generator(std::random_device{}());
+    auto gen = [&](auto distribution) {
+        std::vector<uint64_t> out(n);
+        std::generate(out.begin(), out.end(), [&] { return distribution(generator); });
+        std::sort(out.begin(), out.end());
+        return out;
+    };
+    std::vector<std::pair<std::string, std::function<std::vector<uint64_t>()>>> distributions = {
+        {"uniform_dense", std::bind(gen, std::uniform_int_distribution<uint64_t>(0, n * 1000))},
+        {"uniform_sparse", std::bind(gen, std::uniform_int_distribution<uint64_t>(0, n * n))},
+        {"binomial", std::bind(gen, std::binomial_distribution<uint64_t>(1ull << 50))},
+        {"geometric", std::bind(gen, std::geometric_distribution<uint64_t>(1e-10))},
+    };
+
+    OUT_VERBOSE("Generating " << to_metric(n) << " elements (8-byte keys)")
+    for (auto&[dataset, gen_data] : distributions) {
+        auto data = gen_data();
+        auto queries = generate_queries(data.begin(), data.end(), ratio.Get());
+        OUT_VERBOSE("Generated " << to_metric(queries.size()) << " queries on " << dataset)
+        for_types<SLOPE_CLASSES(uint64_t)>([&](auto t) {
+            using class_type = typename decltype(t)::type;
+            benchmark_slope<class_type>(dataset, data, queries);
+        });
+    }
+
+    return 0;
+}
@@ -0,0 +1,143 @@
+// This file is part of PGM-index <https://github.com/gvinciguerra/PGM-index>.
+// Copyright (c) 2021 Giorgio Vinciguerra.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "benchmark.hpp"
+#include "args.hxx"
+#include "pgm/pgm_index.hpp"
+#include "pgm/pgm_search.hpp"
+
+#include <functional>
+#include <limits>
+#include <utility>
+
+#define FOR_EACH_LAYOUT(K, E) pgm::PGMIndex<K, E>, pgm::PGMIndex<K, E, 4, float, pgm::SplitLayout>
+#define SORTED_BATCH_CLASSES(K) FOR_EACH_LAYOUT(K, 16), FOR_EACH_LAYOUT(K, 64), FOR_EACH_LAYOUT(K, 256)
+
+/** Returns the best time per query of three runs of @p f, as the crossover point is sensitive to noise. */
+template<typename F>
+double time_per_query_ns(size_t num_queries, F f) {
+    auto best = std::numeric_limits<double>::max();
+    for (auto run = 0; run < 3; ++run) {
+        auto t0 = timer::now();
+        f();
+        auto t1 = timer::now();
+        best = std::min(best, std::chrono::duration<double, std::nano>(t1 - t0).count() / num_queries);
+    }
+    return best;
+}
+
+template<typename Index, typename K>
+void benchmark_sorted_batch(const std::string &dataset, const std::vector<K> &data, size_t min_batch) {
+    Index index(data.begin(), data.end());
+    auto name = demangle(typeid(Index).name());
+    std::mt19937_64 generator(42);
+    size_t crossover = 0; // The smallest batch size such that sorted batches are faster on it and all larger sizes
+    bool faster = true;
+
+    for (auto batch_size = data.size(); batch_size >= min_batch; batch_size /= 2) {
+        std::vector<K> batch(batch_size);
+        std::generate(batch.begin(), batch.end(), [&] { return data[generator() % data.size()] + generator() % 2; });
+        std::sort(batch.begin(), batch.end());
+
+        auto independent_ns = time_per_query_ns(batch_size, [&] {
+            uint64_t cnt = 0;
+            for (auto &q : batch)
+                cnt += std::distance(data.begin(), pgm::lower_bound(index, data, q));
+            [[maybe_unused]] volatile auto tmp = cnt;
+        });
+
+        std::vector<typename std::vector<K>::const_iterator> out(batch_size);
+        auto sorted_ns = time_per_query_ns(batch_size, [&] {
+            pgm::lower_bound_sorted_batch(index, data.begin(), data.end(), batch.data(), batch_size, out.data());
+            uint64_t cnt = 0;
+            for (auto it : out)
+                cnt += std::distance(data.begin(), it);
+            [[maybe_unused]] volatile auto tmp = cnt;
+        });
+
+        faster = faster && sorted_ns < independent_ns;
+        if (faster)
+            crossover = batch_size;
+        std::cout << dataset << ",\"" << name << "\"," << batch_size << ","
+                  << double(batch_size) / index.segments_count() << "," << independent_ns << "," << sorted_ns
+                  << std::endl;
+    }
+
+    if (crossover)
+        std::cerr << "Sorted batches on " << dataset << " with " << name << " are faster from " << crossover
+                  << " keys (" << double(crossover) / index.segments_count() << " keys per segment)" << std::endl;
+    else
+        std::cerr << "Sorted batches on " << dataset << " with " << name << " are never faster" << std::endl;
+}
+
+int main(int argc, char **argv) {
+    using namespace args;
+    ArgumentParser p("Compares lookups of sorted batches of keys with independent lookups in the PGM-index.");
+    p.helpParams.flagindent = 2;
+    p.helpParams.helpindent = 25;
+    p.helpParams.progindent = 0;
+    p.helpParams.descriptionindent = 0;
+
+    HelpFlag help(p, "help", "Display this help menu", {'h', "help"});
+    Flag verbose(p, "", "Verbose output", {'v', "verbose"});
+    ValueFlag<size_t> synthetic(p, "size", "Size of the synthetic data", {'s', "synthetic"}, 100000000);
+    ValueFlag<size_t> min_batch(p, "size", "Size of the smallest batch", {'b', "min-batch"}, 1000);
+
+    try {
+        p.ParseCLI(argc, argv);
+    }
+    catch (args::Help &) {
+        std::cout << p;
+        return 0;
+    }
+    catch (args::Error &e) {
+        std::cerr << e.what() << std::endl;
+        std::cerr << p;
+        return 1;
+    }
+
+    if (synthetic.Get() < 1000) {
+        std::cerr << "Argument to --" << synthetic.GetMatcher().GetLongOrAny().str() << " must be greater than 1000.";
+        return 1;
+    }
+
+    global_verbose = verbose.Get();
+    std::cout << "dataset,class_name,batch_size,keys_per_segment,independent_ns,sorted_batch_ns" << std::endl;
+
+    auto n = synthetic.Get();
+    std::mt19937 generator(std::random_device{}());
+    auto gen = [&](auto distribution) {
+        std::vector<uint64_t> out(n);
+        std::generate(out.begin(), out.end(), [&] { return distribution(generator); });
+        std::sort(out.begin(), out.end());
+        return out;
+    };
+    std::vector<std::pair<std::string, std::function<std::vector<uint64_t>()>>> distributions = {
+        {"uniform_dense", std::bind(gen, std::uniform_int_distribution<uint64_t>(0, n * 1000))},
+        {"uniform_sparse", std::bind(gen, std::uniform_int_distribution<uint64_t>(0, n * n))},
+        {"binomial", std::bind(gen, std::binomial_distribution<uint64_t>(1ull << 50))},
+        {"geometric", std::bind(gen, std::geometric_distribution<uint64_t>(1e-10))},
+    };
+
+    OUT_VERBOSE("Generating " << to_metric(n) << " elements (8-byte keys)")
+    for (auto&[dataset, gen_data] : distributions) {
+        auto data = gen_data();
+        for_types<SORTED_BATCH_CLASSES(uint64_t)>([&](auto t) {
+            using class_type = typename decltype(t)::type;
+            benchmark_sorted_batch<class_type>(dataset, data, std::max<size_t>(min_batch.Get(), 1));
+        });
+    }
+
+    return 0;
+}
@@ -0,0 +1,143 @@
+// This file is part of PGM-index <https://github.com/gvinciguerra/PGM-index>.
+// Copyright (c) 2021 Giorgio Vinciguerra.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "benchmark.hpp"
+#include "args.hxx"
+#include "pgm/pgm_index_dynamic.hpp"
+
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * Inserts the given keys one at a time and prints the percentiles of the insertion latency of each tenth of them, so
+ * that the growth of the tail latency with the size of the container is visible.
+ * @param max_frozen_runs the argument to enable_background_merges, or 0 for synchronous merges
+ */
+void benchmark_insert_latency(const std::string &dataset, const std::vector<uint64_t> &keys, size_t max_frozen_runs) {
+    pgm::DynamicPGMIndex<uint64_t, uint64_t> index;
+    if (max_frozen_runs)
+        index.enable_background_merges(max_frozen_runs);
+    auto mode = max_frozen_runs ? "background(" + std::to_string(max_frozen_runs) + ")" : std::string("synchronous");
+
+    auto phases = 10;
+    auto phase_size = keys.size() / phases;
+    std::vector<uint64_t> latencies(phase_size);
+    auto total_t0 = timer::now();
+
+    for (auto phase = 0; phase < phases; ++phase) {
+        for (size_t i = 0; i < phase_size; ++i) {
+            auto t0 = timer::now();
+            index.insert_or_assign(keys[phase * phase_size + i], i);
+            auto t1 = timer::now();
+            latencies[i] = std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count();
+        }
+
+        std::sort(latencies.begin(), latencies.end());
+        auto percentile = [&](double p) { return latencies[std::min<size_t>(p * phase_size, phase_size - 1)]; };
+        std::cout << dataset << "," << mode << "," << (phase + 1) * phase_size << "," << percentile(0.5) << ","
+                  << percentile(0.99) << "," << percentile(0.999) << "," << percentile(0.9999) << ","
+                  << latencies.back() << std::endl;
+    }
+
+    index.wait_merges();
+    auto total_t1 = timer::now();
+    auto total_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(total_t1 - total_t0).count();
+    std::cerr << "Insertions on " << dataset << " with " << mode << " merges: "
+              << double(total_ns) / (phases * phase_size) << " ns/insert on average" << std::endl;
+}
+
+/**
+ * Loads the given keys with insert_bulk on batches of @p batch_size keys, and with insert_or_assign on each key.
+ */
+void benchmark_bulk_load(const std::string &dataset, const std::vector<uint64_t> &keys, size_t batch_size) {
+    std::vector<std::pair<uint64_t, uint64_t>> pairs(keys.size());
+    std::transform(keys.begin(), keys.end(), pairs.begin(), [](auto k) { return std::make_pair(k, k); });
+
+    pgm::DynamicPGMIndex<uint64_t, uint64_t> bulk;
+    auto t0 = timer::now();
+    for (size_t i = 0; i < pairs.size(); i += batch_size)
+        bulk.insert_bulk(pairs.begin() + i, pairs.begin() + std::min(pairs.size(), i + batch_size));
+    auto t1 = timer::now();
+
+    pgm::DynamicPGMIndex<uint64_t, uint64_t> single;
+    auto t2 = timer::now();
+    for (auto &[k, v] : pairs)
+        single.insert_or_assign(k, v);
+    auto t3 = timer::now();
+
+    auto bulk_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count();
+    auto single_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(t3 - t2).count();
+    std::cerr << "Loading " << dataset << ": " << double(bulk_ns) / keys.size() << " ns/key with batches of "
+              << to_metric(batch_size) << " keys, " << double(single_ns) / keys.size() << " ns/key one at a time"
+              << std::endl;
+}
+
+int main(int argc, char **argv) {
+    using namespace args;
+    ArgumentParser p("Measures the latency percentiles of the insertions in the Dynamic PGM-index.");
+    p.helpParams.flagindent = 2;
+    p.helpParams.helpindent = 25;
+    p.helpParams.progindent = 0;
+    p.helpParams.descriptionindent = 0;
+
+    HelpFlag help(p, "help", "Display this help menu", {'h', "help"});
+    Flag verbose(p, "", "Verbose output", {'v', "verbose"});
+    ValueFlag<size_t> synthetic(p, "size", "Number of insertions", {'s', "synthetic"}, 20000000);
+    ValueFlagList<size_t> frozen(p, "runs", "Maximum number of frozen buffers of a background mode (repeatable)",
+                                 {'f', "frozen"}, {4, 32});
+    ValueFlag<size_t> batch(p, "size", "Size of the batches of the bulk loading", {'b', "batch"}, 1000000);
+
+    try {
+        p.ParseCLI(argc, argv);
+    }
+    catch (args::Help &) {
+        std::cout << p;
+        return 0;
+    }
+    catch (args::Error &e) {
+        std::cerr << e.what() << std::endl;
+        std::cerr << p;
+        return 1;
+    }
+
+    if (synthetic.Get() < 1000) {
+        std::cerr << "Argument to --" << synthetic.GetMatcher().GetLongOrAny().str() << " must be greater than 1000.";
+        return 1;
+    }
+
+    global_verbose = verbose.Get();
+    std::cout << "dataset,mode,size,p50_ns,p99_ns,p999_ns,p9999_ns,max_ns" << std::endl;
+
+    auto n = synthetic.Get();
+    std::mt19937_64 generator(42);
+    std::vector<std::pair<std::string, std::vector<uint64_t>>> datasets(2);
+    datasets[0].first = "uniform";
+    datasets[1].first = "sequential";
+    for (size_t i = 0; i < n; ++i) {
+        datasets[0].second.push_back(generator());
+        datasets[1].second.push_back(i);
+    }
+
+    OUT_VERBOSE("Generated " << to_metric(n) << " insertions (8-byte keys)")
+    for (auto &[dataset, keys] : datasets) {
+        benchmark_insert_latency(dataset, keys, 0);
+        for (auto runs : frozen.Get())
+            benchmark_insert_latency(dataset, keys, runs);
+        benchmark_bulk_load(dataset, keys, std::max<size_t>(batch.Get(), 1));
+    }
+
+    return 0;
+}
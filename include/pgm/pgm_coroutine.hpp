@@ -0,0 +1,303 @@
+// This file is part of PGM-index <https://github.com/gvinciguerra/PGM-index>.
+// Copyright (c) 2021 Giorgio Vinciguerra.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+#define PGM_COROUTINES_ENABLED 1
+#endif
+
+#ifdef PGM_COROUTINES_ENABLED
+
+#include "pgm_index.hpp"
+#include "pgm_search.hpp"
+
+#include <algorithm>
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <iterator>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace pgm {
+
+namespace internal {
+
+/**
+ * A per-thread cache of the memory blocks that hold the state of suspended lookups. Lookups of the same kind have
+ * frames of the same size, so the blocks freed by completed lookups are reused by the next ones.
+ */
+class FramePool {
+    std::vector<void *> blocks;
+    size_t block_size = 0;
+
+public:
+    static FramePool &local() {
+        thread_local FramePool pool;
+        return pool;
+    }
+
+    void *allocate(size_t size) {
+        if (size == block_size && !blocks.empty()) {
+            auto p = blocks.back();
+            blocks.pop_back();
+            return p;
+        }
+        return ::operator new(size);
+    }
+
+    void deallocate(void *p, size_t size) {
+        if (size != block_size) {
+            release();
+            block_size = size;
+        }
+        blocks.push_back(p);
+    }
+
+    void release() {
+        for (auto p : blocks)
+            ::operator delete(p);
+        blocks.clear();
+    }
+
+    ~FramePool() { release(); }
+};
+
+} // namespace internal
+
+/**
+ * A lookup that runs as a coroutine and suspends itself after issuing the prefetches for the memory it reads next.
+ *
+ * The lookup does not start until it is resumed for the first time, and its result is available when @ref done returns
+ * @c true. Lookups are meant to be resumed in turn by @ref run_interleaved, so that the cache misses of the lookups
+ * in flight overlap.
+ * @tparam T the type of the result of the lookup
+ */
+template<typename T>
+class LookupTask {
+public:
+    struct promise_type {
+        T value;
+
+        LookupTask get_return_object() { return LookupTask(std::coroutine_handle<promise_type>::from_promise(*this)); }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        std::suspend_always final_suspend() noexcept { return {}; }
+        void return_value(T v) { value = v; }
+        void unhandled_exception() { std::terminate(); }
+
+        static void *operator new(size_t size) { return internal::FramePool::local().allocate(size); }
+        static void operator delete(void *p, size_t size) { internal::FramePool::local().deallocate(p, size); }
+    };
+
+    LookupTask() = default;
+
+    LookupTask(LookupTask &&other) noexcept : handle(std::exchange(other.handle, nullptr)) {}
+
+    LookupTask &operator=(LookupTask &&other) noexcept {
+        if (this != &other) {
+            if (handle)
+                handle.destroy();
+            handle = std::exchange(other.handle, nullptr);
+        }
+        return *this;
+    }
+
+    ~LookupTask() {
+        if (handle)
+            handle.destroy();
+    }
+
+    /** Runs the lookup until its next suspension point or until it completes. */
+    void resume() { handle.resume(); }
+
+    /** Returns @c true if the lookup has completed. */
+    bool done() const { return handle.done(); }
+
+    /** Returns the result of a completed lookup. */
+    const T &result() const { return handle.promise().value; }
+
+private:
+    std::coroutine_handle<promise_type> handle = nullptr;
+
+    explicit LookupTask(std::coroutine_handle<promise_type> handle) : handle(handle) {}
+};
+
+namespace internal {
+
+/**
+ * The descent of a key through the levels of a @ref PGMIndex, split into steps that can be interleaved with the
+ * descents of other keys. Each call to @ref prefetch_level computes the window of segments to search in the next level
+ * and prefetches it, and the following call to @ref descend searches the window.
+ */
+template<typename Index, typename K>
+class LevelsDescent {
+    using position = typename Index::position;
+
+    const Index &index;
+    K key;
+    position it;
+    int level;
+    std::pair<position, position> window;
+
+public:
+
+    LevelsDescent(const Index &index, const K &key) : index(index), key(std::max(index.first_key, key)), window() {
+        if (index.height() == 1) {
+            it = index.segment_for_key(this->key);
+            level = -1;
+            return;
+        }
+        it = index.segment_at(*(index.levels_offsets.end() - 2));
+        level = int(index.height()) - 2;
+    }
+
+    /**
+     * Prefetches the window of segments to search in the next level.
+     * @return @c false if the segment responsible for the key has already been found
+     */
+    bool prefetch_level() {
+        if (level < 0)
+            return false;
+        window = index.level_window(it, level, key);
+        index.prefetch_window(window.first, window.second);
+        return true;
+    }
+
+    /** Searches the window of segments prefetched by the last call to @ref prefetch_level. */
+    void descend() {
+        it = index.search_window(window.first, window.second, key);
+        --level;
+    }
+
+    /** Returns the approximate position of the key, once @ref prefetch_level has returned @c false. */
+    ApproxPos approx_pos() const {
+        auto pos = index.predict(it, key);
+        auto lo = PGM_SUB_EPS(pos, Index::epsilon_value);
+        auto hi = PGM_ADD_EPS(pos, Index::epsilon_value, index.n);
+        return {pos, lo, hi};
+    }
+};
+
+} // namespace internal
+
+/**
+ * Returns a lookup that computes the same result of @c index.search(key), suspending before the search of each level.
+ * @param index a @ref PGMIndex, or a variant derived from it
+ * @param key the value of the element to search for
+ * @return a lookup whose result is a struct with the approximate position and bounds of the range
+ */
+template<typename Index, typename K>
+LookupTask<ApproxPos> search_task(const Index &index, K key) {
+    internal::LevelsDescent<Index, K> descent(index, key);
+    while (descent.prefetch_level()) {
+        co_await std::suspend_always{};
+        descent.descend();
+    }
+    co_return descent.approx_pos();
+}
+
+/**
+ * Returns a lookup that computes the same result of @c pgm::lower_bound(index, first, last, key), suspending before the
+ * search of each level and before the search of the window of keys in [first, last).
+ * @param index an index built on the range [first, last)
+ * @param first, last the range of sorted keys on which @p index was built
+ * @param key the value of the element to search for
+ * @return a lookup whose result is an iterator to the first element not less than @p key, or @p last
+ */
+template<typename Index, typename RandomIt, typename K>
+LookupTask<RandomIt> lower_bound_task(const Index &index, RandomIt first, RandomIt last, K key) {
+    internal::LevelsDescent<Index, K> descent(index, key);
+    while (descent.prefetch_level()) {
+        co_await std::suspend_always{};
+        descent.descend();
+    }
+
+    auto range = internal::clamp_range(descent.approx_pos(), std::distance(first, last));
+    auto lo = first + range.lo;
+    auto n = range.hi - range.lo;
+    if constexpr (internal::is_contiguous_iterator_v<RandomIt>) {
+        // Halve the window with a suspension at each probe until it is short enough to be scanned, then prefetch it
+        using value_type = typename std::iterator_traits<RandomIt>::value_type;
+        while (n * sizeof(value_type) > internal::linear_scan_threshold) {
+            auto half = n / 2;
+            __builtin_prefetch(&*(lo + half));
+            co_await std::suspend_always{};
+            lo = lo[half] < key ? lo + half : lo;
+            n -= half;
+        }
+        for (size_t i = 0; i < n * sizeof(value_type); i += 64)
+            __builtin_prefetch((const char *) &*lo + i);
+        co_await std::suspend_always{};
+    }
+    co_return internal::window_lower_bound(lo, lo + n, key);
+}
+
+/**
+ * Returns a lookup that computes the same result of @c container.lower_bound(key) on a container that stores its keys
+ * together with its index, such as @ref MappedPGMIndex.
+ * @param container the container to search
+ * @param key the value of the element to search for
+ * @return a lookup whose result is an iterator to the first element not less than @p key, or @c container.end()
+ */
+template<typename Container, typename K>
+auto lower_bound_task(const Container &container, K key) {
+    return lower_bound_task(container, container.begin(), container.end(), key);
+}
+
+/**
+ * Runs @p count lookups keeping at most @p in_flight of them suspended at the same time, and resuming them in
+ * round-robin order. Whenever a lookup completes, it is replaced by the next one, so that the cache misses of up to
+ * @p in_flight lookups overlap.
+ * @param count the number of lookups to run
+ * @param in_flight the maximum number of lookups in flight
+ * @param make a function that, given an integer i in [0, count), returns the ith lookup
+ * @param done a function that is called with i and the result of the ith lookup when it completes
+ */
+template<typename Make, typename Done>
+void run_interleaved(size_t count, size_t in_flight, Make make, Done done) {
+    using task_type = std::invoke_result_t<Make, size_t>;
+    std::vector<std::pair<task_type, size_t>> slots;
+    slots.reserve(std::max<size_t>(in_flight, 1));
+
+    size_t next = 0;
+    for (; next < count && slots.size() < std::max<size_t>(in_flight, 1); ++next)
+        slots.emplace_back(make(next), next);
+
+    while (!slots.empty()) {
+        for (size_t j = 0; j < slots.size();) {
+            auto &[task, i] = slots[j];
+            task.resume();
+            if (!task.done()) {
+                ++j;
+                continue;
+            }
+            done(i, task.result());
+            if (next < count) {
+                task = make(next);
+                i = next++;
+                ++j;
+            } else {
+                slots[j] = std::move(slots.back());
+                slots.pop_back();
+            }
+        }
+    }
+}
+
+}
+
+#endif
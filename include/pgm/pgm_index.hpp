@@ -16,12 +16,17 @@
 #pragma once
 
 #include "piecewise_linear_model.hpp"
+#include "pgm_search.hpp"
 #include <algorithm>
+#include <cmath>
 #include <cstddef>
 #include <cstdint>
 #include <iterator>
 #include <limits>
+#include <memory>
+#include <new>
 #include <stdexcept>
+#include <type_traits>
 #include <utility>
 #include <vector>
 
@@ -40,6 +45,391 @@ struct ApproxPos {
     size_t hi;  ///< The upper bound of the range.
 };
 
+#pragma pack(push, 1)
+
+/**
+ * A slope in fixed-point representation that can be used in place of the @c Floating type of a @ref PGMIndex on
+ * integer keys of up to 64 bits.
+ *
+ * The slope is stored as an integer multiplier and a right shift, chosen at build time to keep the digits(Multiplier)
+ * most significant bits of the floating-point slope computed by the segmentation, so that evaluating a segment is an
+ * integer multiplication followed by a shift, with no conversion between integers and floating-point numbers. With
+ * 64-bit keys, or with a 64-bit multiplier, the product is taken on 128 bits and the shift reads its high part.
+ * A 32-bit multiplier is already more precise than a @c float slope.
+ *
+ * @tparam Multiplier the unsigned integer type of the multiplier, either @c uint32_t or @c uint64_t
+ */
+template<typename Multiplier = uint32_t>
+struct FixedPointSlope {
+    static_assert(std::is_same_v<Multiplier, uint32_t> || std::is_same_v<Multiplier, uint64_t>);
+
+    Multiplier multiplier; ///< The slope multiplied by 2^shift and rounded.
+    uint8_t shift;         ///< The number of fractional bits of the multiplier.
+
+    FixedPointSlope() = default;
+
+    /**
+     * Converts a non-negative floating-point slope to fixed point.
+     * @param slope the slope to convert
+     */
+    FixedPointSlope(long double slope) : multiplier(0), shift(0) {
+        if (!(slope > 0))
+            return;
+        constexpr int digits = std::numeric_limits<Multiplier>::digits;
+        constexpr auto limit = (long double) std::numeric_limits<Multiplier>::max();
+        auto exponent = std::clamp(digits - 1 - std::ilogb(slope), 0, 127);
+        auto scaled = std::nearbyint(std::ldexp(slope, exponent));
+        if (scaled > limit && exponent > 0)
+            scaled = std::nearbyint(std::ldexp(slope, --exponent));
+        multiplier = Multiplier(std::min(scaled, limit));
+        shift = exponent;
+    }
+
+    /**
+     * Converts the slope back to floating point.
+     * @return the value of the slope
+     */
+    explicit operator long double() const { return std::ldexp((long double) multiplier, -int(shift)); }
+
+    /**
+     * Returns the product of the slope and a non-negative key difference, rounded down and capped to 2^62 so that it
+     * can be safely converted to a signed integer.
+     * @param delta the difference between a key and the first key of a segment
+     * @return the product rounded down
+     */
+    template<typename D>
+    uint64_t operator*(const D &delta) const {
+        static_assert(std::is_integral_v<D> && sizeof(D) <= 8, "Fixed-point slopes require integer keys up to 64 bits");
+        constexpr uint64_t cap = 1ull << 62;
+        auto d = std::make_unsigned_t<D>(delta);
+        if constexpr (sizeof(D) <= 4 && sizeof(Multiplier) <= 4) {
+            auto product = uint64_t(d) * multiplier;
+            return shift < 64 ? std::min(product >> shift, cap) : 0;
+        } else {
+            auto product = (unsigned __int128) d * multiplier;
+            return uint64_t(std::min<unsigned __int128>(product >> shift, cap));
+        }
+    }
+
+    friend bool operator==(const FixedPointSlope &a, const FixedPointSlope &b) {
+        return a.multiplier == b.multiplier && a.shift == b.shift;
+    }
+};
+
+#pragma pack(pop)
+
+namespace internal {
+
+template<typename T>
+constexpr bool is_fixed_point_slope_v = false;
+
+template<typename Multiplier>
+constexpr bool is_fixed_point_slope_v<FixedPointSlope<Multiplier>> = true;
+
+/** An allocator that returns memory aligned to @p Alignment bytes. */
+template<typename T, size_t Alignment = 64>
+struct AlignedAllocator {
+    using value_type = T;
+
+    template<typename U>
+    struct rebind { using other = AlignedAllocator<U, Alignment>; };
+
+    AlignedAllocator() = default;
+
+    template<typename U>
+    AlignedAllocator(const AlignedAllocator<U, Alignment> &) {}
+
+    T *allocate(size_t n) { return static_cast<T *>(::operator new(n * sizeof(T), std::align_val_t(Alignment))); }
+
+    void deallocate(T *p, size_t) { ::operator delete(p, std::align_val_t(Alignment)); }
+
+    template<typename U>
+    bool operator==(const AlignedAllocator<U, Alignment> &) const { return true; }
+
+    template<typename U>
+    bool operator!=(const AlignedAllocator<U, Alignment> &) const { return false; }
+};
+
+/**
+ * An immutable array whose elements are either owned in a @c std::vector or stored in memory that is owned elsewhere,
+ * such as a memory-mapped file, and that is kept alive by a shared pointer. In the latter case the elements are used in
+ * place, without copying them.
+ */
+template<typename T, typename Allocator = std::allocator<T>>
+class ReadOnlyArray {
+    std::vector<T, Allocator> owned;  ///< The elements, if they are owned by this array.
+    std::shared_ptr<const void> keep; ///< The owner of the elements, if they are not owned by this array.
+    const T *ptr = nullptr;           ///< Pointer to the first element.
+    size_t count = 0;                 ///< The number of elements.
+
+public:
+    using value_type = T;
+    using size_type = size_t;
+    using const_iterator = const T *;
+    using iterator = const_iterator;
+
+    ReadOnlyArray() = default;
+
+    ReadOnlyArray(std::vector<T, Allocator> &&v) : owned(std::move(v)), ptr(owned.data()), count(owned.size()) {}
+
+    /**
+     * Constructs an array on @p count elements starting at @p ptr, which must stay valid as long as @p keep is alive.
+     */
+    ReadOnlyArray(const T *ptr, size_t count, std::shared_ptr<const void> keep)
+        : owned(), keep(std::move(keep)), ptr(ptr), count(count) {}
+
+    ReadOnlyArray(const ReadOnlyArray &other)
+        : owned(other.owned), keep(other.keep), ptr(other.ptr), count(other.count) {
+        if (!keep)
+            ptr = owned.data();
+    }
+
+    ReadOnlyArray(ReadOnlyArray &&other) noexcept
+        : owned(std::move(other.owned)), keep(std::move(other.keep)), ptr(other.ptr), count(other.count) {
+        other.ptr = nullptr;
+        other.count = 0;
+    }
+
+    ReadOnlyArray &operator=(ReadOnlyArray other) {
+        std::swap(owned, other.owned);
+        std::swap(keep, other.keep);
+        std::swap(ptr, other.ptr);
+        std::swap(count, other.count);
+        return *this;
+    }
+
+    /** Returns @c true if the elements are stored in memory owned elsewhere. */
+    bool is_borrowed() const { return bool(keep); }
+
+    const T *data() const { return ptr; }
+    const_iterator begin() const { return ptr; }
+    const_iterator end() const { return ptr + count; }
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    const T &operator[](size_t i) const { return ptr[i]; }
+    const T &back() const { return ptr[count - 1]; }
+
+    friend bool operator==(const ReadOnlyArray &a, const ReadOnlyArray &b) {
+        return std::equal(a.begin(), a.end(), b.begin(), b.end());
+    }
+};
+
+/**
+ * Returns the offset that a linear model with the given slope predicts for @p k, relative to the key @p origin where
+ * the model starts. With 128-bit keys the difference of the keys is taken on unsigned integers and the product is
+ * computed at least in double precision, so that a large key delta does not push the position out of the epsilon bound.
+ * The product is also capped, as a steep segment (e.g. at the end of a run of duplicates) evaluated on a key far beyond
+ * it would otherwise overflow the integer conversion done by the caller.
+ */
+template<typename Floating, typename K>
+auto model_offset(Floating slope, const K &k, const K &origin) {
+    auto delta = key_delta(k, origin);
+    if constexpr (is_wide_integer_v<K>) {
+        static_assert(!is_fixed_point_slope_v<Floating>, "Fixed-point slopes require integer keys up to 64 bits");
+        using product_type = decltype(slope * 1.);
+        return std::min(product_type(slope) * product_type(delta), product_type(0x1p62));
+    } else
+        return slope * delta;
+}
+
+#pragma pack(push, 1)
+
+/** A segment of a @ref PGMIndex, that is, a linear model approximating the position of the keys from @ref key on. */
+template<typename K, typename Floating>
+struct Segment {
+    K key;             ///< The first key that the segment indexes.
+    Floating slope;    ///< The slope of the segment.
+    int32_t intercept; ///< The intercept of the segment.
+
+    Segment() = default;
+
+    Segment(K key, Floating slope, int32_t intercept) : key(key), slope(slope), intercept(intercept) {};
+
+    explicit Segment(size_t n) : key(std::numeric_limits<K>::max()), slope(), intercept(n) {};
+
+    explicit Segment(const typename internal::OptimalPiecewiseLinearModel<K, size_t>::CanonicalSegment &cs)
+        : key(cs.get_first_x()) {
+        auto[cs_slope, cs_intercept] = cs.get_floating_point_segment(key);
+        if (cs_intercept > std::numeric_limits<decltype(intercept)>::max())
+            throw std::overflow_error("Change the type of Segment::intercept to int64");
+        slope = cs_slope;
+        intercept = cs_intercept;
+    }
+
+    friend inline bool operator<(const Segment &s, const K &k) { return s.key < k; }
+    friend inline bool operator<(const K &k, const Segment &s) { return k < s.key; }
+    friend inline bool operator<(const Segment &s, const Segment &t) { return s.key < t.key; }
+
+    operator K() { return key; };
+
+    /**
+     * Returns the approximate position of the specified key.
+     * @param k the key whose position must be approximated
+     * @return the approximate position of the specified key
+     */
+    inline size_t operator()(const K &k) const {
+        auto pos = int64_t(internal::model_offset(slope, k, key)) + intercept;
+        return pos > 0 ? size_t(pos) : 0ull;
+    }
+};
+
+#pragma pack(pop)
+
+/**
+ * Returns the number of keys of the sorted range [first, last) that are mapped to points of the first level of the
+ * index, that is, all of them except a trailing max(), which is the sentinel value.
+ */
+template<typename RandomIt>
+size_t first_level_size(RandomIt first, RandomIt last) {
+    using K = typename std::iterator_traits<RandomIt>::value_type;
+    auto n = (size_t) std::distance(first, last);
+    return n - (n > 0 && *std::prev(last) == std::numeric_limits<K>::max());
+}
+
+/**
+ * Returns the abscissa of the point of a key @p x in the first level of the index, given its predecessor @p prev and
+ * its successor @p next in the input. This is the adjustment for inputs with duplicate keys: at the end of a run of
+ * duplicate keys equal to x such that x+1!=next, we map the values x+1,...,next-1 to the rank of x.
+ *
+ * The comparisons are combined without short-circuiting, so that this is branch-free. Since the input is sorted,
+ * x!=next implies x<max(), hence x is incremented only when this cannot overflow.
+ */
+template<typename K>
+K adjust_duplicate_key(const K &prev, const K &x, const K &next) {
+    auto bumped = K(x + K(x != next));
+    auto flag = (x == prev) & (bumped != next);
+    return K(x + K(flag));
+}
+
+/**
+ * Returns the abscissa of the point of the key at position @p i of the sorted range of @p n keys starting at @p first,
+ * where the first and the last key have no adjustment for duplicates.
+ */
+template<typename RandomIt>
+auto first_level_key(RandomIt first, size_t n, size_t i) {
+    using K = typename std::iterator_traits<RandomIt>::value_type;
+    if (i == 0 || i + 1 >= n)
+        return K(first[i]);
+    return adjust_duplicate_key<K>(first[i - 1], first[i], first[i + 1]);
+}
+
+} // namespace internal
+
+/**
+ * Layout policy of @ref PGMIndex that stores the key, slope and intercept of each segment contiguously.
+ *
+ * A layout provides the storage of the segments, which @ref PGMIndex derives from, and the type of the position of a
+ * segment, which supports the arithmetic of a random-access iterator, so that the same search code runs on any layout.
+ */
+struct InterleavedLayout {
+    template<typename K, typename Floating>
+    struct storage {
+        using Segment = internal::Segment<K, Floating>;
+
+        using position = const Segment *; ///< The position of a segment.
+
+        internal::ReadOnlyArray<Segment> segments; ///< The segments composing the index.
+
+        static constexpr size_t key_stride = sizeof(Segment); ///< The distance in bytes between consecutive keys.
+
+        /** Takes over the segments built by @ref PGMIndex::build. */
+        void assign(std::vector<Segment> &&built) { segments = std::move(built); }
+
+        /** Returns the number of stored segments, sentinels included. */
+        size_t stored_count() const { return segments.size(); }
+
+        /** Returns the size in bytes of the stored segments. */
+        size_t stored_bytes() const { return segments.size() * sizeof(Segment); }
+
+        /** Returns the position of the ith stored segment. */
+        position segment_at(size_t i) const { return segments.data() + i; }
+
+        /** Returns the first key of the segment at @p p. */
+        static K key_at(position p) { return p->key; }
+
+        /** Returns the address of the first key of the segment at @p p, followed by the others every key_stride. */
+        static const void *key_data(position p) { return p; }
+
+        /**
+         * Returns the approximate position of a key according to a segment, clamped to the intercept of the next one.
+         * @param p the position of the segment
+         * @param k the key whose position must be approximated
+         * @return the approximate position of the specified key
+         */
+        static size_t predict(position p, const K &k) { return std::min<size_t>((*p)(k), std::next(p)->intercept); }
+    };
+};
+
+/**
+ * Layout policy of @ref PGMIndex that stores the keys and the linear models of the segments in separate arrays.
+ *
+ * Both arrays are aligned to the cache line size. The search through each level scans only the keys, and the model of
+ * a segment is read only after the segment has been chosen, so that the cache lines fetched during a search are not
+ * wasted on slopes and intercepts.
+ */
+struct SplitLayout {
+    template<typename K, typename Floating>
+    struct storage {
+        struct Model {
+            Floating slope;    ///< The slope of the segment.
+            int32_t intercept; ///< The intercept of the segment.
+        };
+
+        template<typename T>
+        using aligned_vector = std::vector<T, internal::AlignedAllocator<T>>;
+
+        template<typename T>
+        using aligned_array = internal::ReadOnlyArray<T, internal::AlignedAllocator<T>>;
+
+        using position = size_t; ///< The position of a segment.
+
+        aligned_array<K> keys;       ///< The first key of each segment composing the index.
+        aligned_array<Model> models; ///< The linear model of each segment composing the index.
+
+        static constexpr size_t key_stride = sizeof(K); ///< The distance in bytes between consecutive keys.
+
+        /** Splits the segments built by @ref PGMIndex::build into keys[] and models[]. */
+        void assign(std::vector<internal::Segment<K, Floating>> &&built) {
+            aligned_vector<K> segments_keys;
+            aligned_vector<Model> segments_models;
+            segments_keys.reserve(built.size());
+            segments_models.reserve(built.size());
+            for (auto &s : built) {
+                segments_keys.push_back(K(s.key));
+                segments_models.push_back({s.slope, s.intercept});
+            }
+            keys = std::move(segments_keys);
+            models = std::move(segments_models);
+        }
+
+        /** Returns the number of stored segments, sentinels included. */
+        size_t stored_count() const { return keys.size(); }
+
+        /** Returns the size in bytes of the stored segments. */
+        size_t stored_bytes() const { return keys.size() * sizeof(K) + models.size() * sizeof(Model); }
+
+        /** Returns the position of the ith stored segment. */
+        position segment_at(size_t i) const { return i; }
+
+        /** Returns the first key of the segment at @p i. */
+        K key_at(position i) const { return keys[i]; }
+
+        /** Returns the address of the first key of the segment at @p i, followed by the others every key_stride. */
+        const void *key_data(position i) const { return keys.data() + i; }
+
+        /**
+         * Returns the approximate position of a key according to a segment, clamped to the intercept of the next one.
+         * @param i the position of the segment
+         * @param k the key whose position must be approximated
+         * @return the approximate position of the specified key
+         */
+        size_t predict(position i, const K &k) const {
+            auto pos = int64_t(internal::model_offset(models[i].slope, k, keys[i])) + models[i].intercept;
+            return std::min<size_t>(pos > 0 ? size_t(pos) : 0ull, models[i + 1].intercept);
+        }
+    };
+};
+
 /**
  * A space-efficient index that enables fast search operations on a sorted sequence of @c n numbers.
  *
@@ -56,13 +446,21 @@ struct ApproxPos {
  * This mapping is represented as a sequence of linear models (segments) which, if @p EpsilonRecursive is not zero, are
  * themselves recursively indexed by other piecewise linear mappings.
  *
+ * The @p Layout template parameter selects how the segments are stored in memory. With @ref InterleavedLayout (the
+ * default) the key, slope and intercept of a segment are packed together. With @ref SplitLayout the keys and the
+ * linear models are kept in two separate cache-aligned arrays, so that the search through the levels reads only keys.
+ *
  * @tparam K the type of the indexed keys
  * @tparam Epsilon controls the size of the returned search range
  * @tparam EpsilonRecursive controls the size of the search range in the internal structure
  * @tparam Floating the floating-point type to use for slopes
+ * @tparam Layout the memory layout of the segments, either @ref InterleavedLayout or @ref SplitLayout
  */
-template<typename K, size_t Epsilon = 64, size_t EpsilonRecursive = 4, typename Floating = float>
-class PGMIndex {
+template<typename K, size_t Epsilon = 64, size_t EpsilonRecursive = 4, typename Floating = float,
+         typename Layout = InterleavedLayout>
+class PGMIndex : public Layout::template storage<K, Floating> {
+    using storage_type = typename Layout::template storage<K, Floating>;
+
 public:
     template<typename, size_t, size_t, uint8_t, typename>
     friend class BucketingPGMIndex;
@@ -71,12 +469,11 @@ public:
     friend class EliasFanoPGMIndex;
 
     static_assert(Epsilon > 0);
-    struct Segment;
+    using Segment = internal::Segment<K, Floating>;
 
-    size_t n;                           ///< The number of elements this index was built on.
-    K first_key;                        ///< The smallest element.
-    std::vector<Segment> segments;      ///< The segments composing the index.
-    std::vector<size_t> levels_offsets; ///< The starting position of each level in segments[], in reverse order.
+    size_t n;                                       ///< The number of elements this index was built on.
+    K first_key;                                    ///< The smallest element.
+    internal::ReadOnlyArray<size_t> levels_offsets; ///< The start of each level in the segments, in reverse order.
 
     template<typename RandomIt>
     static void build(RandomIt first, RandomIt last,
@@ -90,73 +487,191 @@ public:
         levels_offsets.push_back(0);
         segments.reserve(n / (epsilon * epsilon));
 
-        auto ignore_last = *std::prev(last) == std::numeric_limits<K>::max(); // max() is the sentinel value
-        auto last_n = n - ignore_last;
-        last -= ignore_last;
-
-        auto build_level = [&](auto epsilon, auto in_fun, auto out_fun) {
-            auto n_segments = internal::make_segmentation_par(last_n, epsilon, in_fun, out_fun);
-            if (last_n > 1 && segments.back().slope == 0) {
-                // Here we need to ensure that keys > *(last-1) are approximated to a position == prev_level_size
-                segments.emplace_back(*std::prev(last) + 1, 0, last_n);
-                ++n_segments;
-            }
-            segments.emplace_back(last_n); // Add the sentinel segment
-            return n_segments;
-        };
+        auto last_n = internal::first_level_size(first, last);
+        last = first + last_n;
 
         // Build first level
-        auto in_fun = [&](auto i) {
-            auto x = first[i];
-            // Here there is an adjustment for inputs with duplicate keys: at the end of a run of duplicate keys equal
-            // to x=first[i] such that x+1!=first[i+1], we map the values x+1,...,first[i+1]-1 to their correct rank i
-            auto flag = i > 0 && i + 1u < n && x == first[i - 1] && x != first[i + 1] && x + 1 != first[i + 1];
-            return std::pair<K, size_t>(x + flag, i);
-        };
+        auto in_fun = [&](auto i) { return std::pair<K, size_t>(internal::first_level_key(first, n, i), i); };
         auto out_fun = [&](auto cs) { segments.emplace_back(cs); };
-        last_n = build_level(epsilon, in_fun, out_fun);
+        auto last_key = last_n ? *std::prev(last) : K(0);
+        auto n_segments = internal::make_segmentation_par(last_n, epsilon, in_fun, out_fun);
+        last_n = close_level(n_segments, last_n, last_key, segments);
         levels_offsets.push_back(levels_offsets.back() + last_n + 1);
 
-        // Build upper levels
+        build_upper_levels(last_n, last_key, epsilon_recursive, segments, levels_offsets);
+    }
+
+    template<typename RandomIt>
+    static void build(RandomIt first, RandomIt last,
+                      size_t epsilon, size_t epsilon_recursive,
+                      internal::ReadOnlyArray<Segment> &segments,
+                      internal::ReadOnlyArray<size_t> &levels_offsets) {
+        std::vector<Segment> built_segments;
+        std::vector<size_t> built_levels_offsets;
+        build(first, last, epsilon, epsilon_recursive, built_segments, built_levels_offsets);
+        segments = std::move(built_segments);
+        levels_offsets = std::move(built_levels_offsets);
+    }
+
+    /**
+     * Completes a level of @p n_segments segments built on @p last_n points by appending the sentinel segment and, if
+     * needed, a segment that approximates the keys greater than @p last_key to the position @p last_n.
+     * @return the number of segments in the level, excluding the sentinel
+     */
+    static size_t close_level(size_t n_segments, size_t last_n, const K &last_key, std::vector<Segment> &segments) {
+        if (last_n > 1 && segments.back().slope == 0 && last_key < std::numeric_limits<K>::max()) {
+            // Here we need to ensure that keys > last_key are approximated to a position == prev_level_size
+            segments.emplace_back(last_key + 1, 0, last_n);
+            ++n_segments;
+        }
+        segments.emplace_back(last_n); // Add the sentinel segment
+        return n_segments;
+    }
+
+    /**
+     * Recursively builds the upper levels of the index on top of a first level of @p last_n segments.
+     * @param last_n the number of segments in the first level
+     * @param last_key the greatest non-sentinel key indexed by the first level
+     */
+    static void build_upper_levels(size_t last_n, const K &last_key, size_t epsilon_recursive,
+                                   std::vector<Segment> &segments, std::vector<size_t> &levels_offsets) {
+        auto out_fun = [&](auto cs) { segments.emplace_back(cs); };
         while (epsilon_recursive && last_n > 1) {
             auto offset = levels_offsets[levels_offsets.size() - 2];
-            auto in_fun_rec = [&](auto i) { return std::pair<K, size_t>(segments[offset + i].key, i); };
-            last_n = build_level(epsilon_recursive, in_fun_rec, out_fun);
+            // Copy the key, since binding a reference to a packed 128-bit member may produce a misaligned load
+            auto in_fun_rec = [&](auto i) { return std::pair<K, size_t>(K(segments[offset + i].key), i); };
+            auto n_segments = internal::make_segmentation_par(last_n, epsilon_recursive, in_fun_rec, out_fun);
+            last_n = close_level(n_segments, last_n, last_key, segments);
             levels_offsets.push_back(levels_offsets.back() + last_n + 1);
         }
     }
 
+    using position = typename storage_type::position;
+
     /**
-     * Returns the segment responsible for a given key, that is, the rightmost segment having key <= the sought key.
+     * Returns the first segment in [lo, hi) whose key is greater than @p key.
+     * @param lo, hi the range of segments to search, whose keys are sorted
      * @param key the value of the element to search for
-     * @return an iterator to the segment responsible for the given key
+     * @return the first segment with key > @p key, or @p hi if there is none
      */
-    auto segment_for_key(const K &key) const {
-        if constexpr (EpsilonRecursive == 0) {
-            return std::prev(std::upper_bound(segments.begin(), segments.begin() + segments_count(), key));
+    position upper_bound_segment(position lo, position hi, const K &key) const {
+        size_t count = hi - lo;
+        while (count > 0) {
+            auto half = count / 2;
+            if (this->key_at(lo + half) <= key) {
+                lo += half + 1;
+                count -= half + 1;
+            } else
+                count = half;
         }
+        return lo;
+    }
 
-        auto it = segments.begin() + *(levels_offsets.end() - 2);
+    /**
+     * Returns the segment responsible for a given key, that is, the rightmost segment having key <= the sought key.
+     * @param key the value of the element to search for
+     * @return the position of the segment responsible for the given key
+     */
+    position segment_for_key(const K &key) const {
+        if constexpr (EpsilonRecursive == 0)
+            return upper_bound_segment(this->segment_at(0), this->segment_at(segments_count()), key) - 1;
 
+        auto it = this->segment_at(*(levels_offsets.end() - 2));
         for (auto l = int(height()) - 2; l >= 0; --l) {
-            auto level_begin = segments.begin() + levels_offsets[l];
-            auto pos = std::min<size_t>((*it)(key), std::next(it)->intercept);
-            auto lo = level_begin + PGM_SUB_EPS(pos, EpsilonRecursive + 1);
-
-            static constexpr size_t linear_search_threshold = 8 * 64 / sizeof(Segment);
-            if constexpr (EpsilonRecursive <= linear_search_threshold) {
-                for (; std::next(lo)->key <= key; ++lo)
-                    continue;
-                it = lo;
-            } else {
-                auto level_size = levels_offsets[l + 1] - levels_offsets[l] - 1;
-                auto hi = level_begin + PGM_ADD_EPS(pos, EpsilonRecursive, level_size);
-                it = std::prev(std::upper_bound(lo, hi, key));
-            }
+            auto[lo, hi] = level_window(it, l, key);
+            it = search_window(lo, hi, key);
         }
         return it;
     }
 
+    /**
+     * Returns the segment responsible for a given key, moving forward in the last level from the segment @p it by
+     * galloping, so that the cost is logarithmic in the number of segments skipped and the upper levels are not read.
+     * If @p key is smaller than the key of @p it, the segment is found with @ref segment_for_key.
+     * @param it a segment in the last level
+     * @param key the value of the element to search for, not less than @ref first_key
+     * @return the position of the segment responsible for the given key
+     */
+    position segment_for_key_from(position it, const K &key) const {
+        auto end = this->segment_at(segments_count());
+        if (it >= end || key < this->key_at(it))
+            return segment_for_key(key);
+
+        size_t remaining = end - 1 - it;
+        size_t step = 1;
+        while (step <= remaining && this->key_at(it + step) <= key) {
+            it += step;
+            remaining -= step;
+            step *= 2;
+        }
+        return upper_bound_segment(it + 1, it + std::min(step, remaining + 1), key) - 1;
+    }
+
+    /**
+     * Returns the range of segments in the level @p l that may be responsible for a given key.
+     * @param it the segment responsible for @p key in the level l+1
+     * @param l the level to search
+     * @param key the value of the element to search for
+     * @return a pair of positions delimiting the candidate segments in the level l
+     */
+    std::pair<position, position> level_window(position it, size_t l, const K &key) const {
+        auto level_begin = this->segment_at(levels_offsets[l]);
+        auto pos = this->predict(it, key);
+        auto lo = level_begin + PGM_SUB_EPS(pos, EpsilonRecursive + 1);
+        if constexpr (EpsilonRecursive <= linear_search_threshold)
+            return {lo, lo};
+        auto level_size = levels_offsets[l + 1] - levels_offsets[l] - 1;
+        return {lo, level_begin + PGM_ADD_EPS(pos, EpsilonRecursive, level_size)};
+    }
+
+    /**
+     * Returns the rightmost segment having key <= the sought key among those returned by @ref level_window.
+     * @param lo, hi the range of candidate segments
+     * @param key the value of the element to search for
+     * @return the position of the segment responsible for the given key
+     */
+    position search_window(position lo, position hi, const K &key) const {
+        if constexpr (EpsilonRecursive <= linear_search_threshold)
+            return scan_window(lo, key);
+        else
+            return upper_bound_segment(lo, hi, key) - 1;
+    }
+
+    /**
+     * Returns the rightmost segment having key <= the sought key, starting from @p lo and moving forward. The keys of
+     * the 2*EpsilonRecursive+2 segments following @p lo, which contain the answer, are compared all at once when they
+     * do not extend past the end of the segments, so that the descent does not depend on a mispredicted branch.
+     * @param lo the leftmost candidate segment
+     * @param key the value of the element to search for
+     * @return the position of the segment responsible for the given key
+     */
+    position scan_window(position lo, const K &key) const {
+        constexpr size_t window = 2 * EpsilonRecursive + 2;
+        if constexpr (window < 64) {
+            if (size_t(this->segment_at(this->stored_count()) - lo) > window)
+                lo += internal::leading_not_greater<window, storage_type::key_stride>(this->key_data(lo + 1), key);
+        }
+        for (; this->key_at(lo + 1) <= key; ++lo)
+            continue;
+        return lo;
+    }
+
+    /**
+     * Issues a prefetch for the keys of the candidate segments returned by @ref level_window.
+     * @param lo, hi the range of candidate segments
+     */
+    void prefetch_window(position lo, position hi) const {
+        if constexpr (EpsilonRecursive <= linear_search_threshold) {
+            auto ptr = (const char *) this->key_data(lo);
+            for (size_t i = 0; i < (2 * EpsilonRecursive + 2) * storage_type::key_stride; i += 64)
+                __builtin_prefetch(ptr + i);
+        } else
+            __builtin_prefetch(this->key_data(lo + (hi - lo) / 2));
+    }
+
+    static constexpr size_t linear_search_threshold = 8 * 64 / storage_type::key_stride;
+    static constexpr size_t batch_group_size = 16;
+
 public:
 
     static constexpr size_t epsilon_value = Epsilon;
@@ -181,11 +696,15 @@ public:
      */
     template<typename RandomIt>
     PGMIndex(RandomIt first, RandomIt last)
-        : n(std::distance(first, last)),
+        : storage_type(),
+          n(std::distance(first, last)),
           first_key(n ? *first : K(0)),
-          segments(),
           levels_offsets() {
-        build(first, last, Epsilon, EpsilonRecursive, segments, levels_offsets);
+        std::vector<Segment> built_segments;
+        std::vector<size_t> built_levels_offsets;
+        build(first, last, Epsilon, EpsilonRecursive, built_segments, built_levels_offsets);
+        this->assign(std::move(built_segments));
+        levels_offsets = std::move(built_levels_offsets);
     }
 
     /**
@@ -195,18 +714,90 @@ public:
      */
     ApproxPos search(const K &key) const {
         auto k = std::max(first_key, key);
-        auto it = segment_for_key(k);
-        auto pos = std::min<size_t>((*it)(k), std::next(it)->intercept);
+        auto pos = this->predict(segment_for_key(k), k);
         auto lo = PGM_SUB_EPS(pos, Epsilon);
         auto hi = PGM_ADD_EPS(pos, Epsilon, n);
         return {pos, lo, hi};
     }
 
+    /**
+     * Returns the approximate positions and the ranges where each key in a batch can be found.
+     *
+     * The keys are processed in groups that descend the levels of the index together: before the segments of a level
+     * are searched, the segments needed by every key in the group are prefetched, so that their cache misses overlap.
+     * The result for each key is the same as calling @ref search on it.
+     * @param keys pointer to the values of the elements to search for
+     * @param count the number of keys in the batch
+     * @param out pointer to an array of size at least @p count where the results are written
+     */
+    void search_batch(const K *keys, size_t count, ApproxPos *out) const {
+        if constexpr (EpsilonRecursive == 0) {
+            for (size_t i = 0; i < count; ++i)
+                out[i] = search(keys[i]);
+            return;
+        }
+
+        K k[batch_group_size];
+        position it[batch_group_size];
+        std::pair<position, position> window[batch_group_size];
+        auto root = this->segment_at(*(levels_offsets.end() - 2));
+
+        for (size_t i = 0; i < count; i += batch_group_size) {
+            auto group_size = std::min(batch_group_size, count - i);
+            for (size_t j = 0; j < group_size; ++j) {
+                k[j] = std::max(first_key, keys[i + j]);
+                it[j] = root;
+            }
+
+            for (auto l = int(height()) - 2; l >= 0; --l) {
+                for (size_t j = 0; j < group_size; ++j) {
+                    window[j] = level_window(it[j], l, k[j]);
+                    prefetch_window(window[j].first, window[j].second);
+                }
+                for (size_t j = 0; j < group_size; ++j)
+                    it[j] = search_window(window[j].first, window[j].second, k[j]);
+            }
+
+            for (size_t j = 0; j < group_size; ++j) {
+                auto pos = this->predict(it[j], k[j]);
+                auto lo = PGM_SUB_EPS(pos, Epsilon);
+                auto hi = PGM_ADD_EPS(pos, Epsilon, n);
+                out[i + j] = {pos, lo, hi};
+            }
+        }
+    }
+
+    /**
+     * Returns the approximate positions and the ranges where each key in a sorted batch can be found.
+     *
+     * Instead of descending the levels of the index for every key, a cursor moves forward on the segments of the last
+     * level, galloping to the segment of the next key, so that the cost approaches O(count + segments touched). The
+     * result for each key is the same as calling @ref search on it. Keys smaller than their predecessor are supported,
+     * but they restart the cursor with a full descent.
+     * @param keys pointer to the values of the elements to search for, sorted in non-decreasing order
+     * @param count the number of keys in the batch
+     * @param out pointer to an array of size at least @p count where the results are written
+     */
+    void search_sorted_batch(const K *keys, size_t count, ApproxPos *out) const {
+        if (count == 0)
+            return;
+
+        auto it = segment_for_key(std::max(first_key, keys[0]));
+        for (size_t i = 0; i < count; ++i) {
+            auto k = std::max(first_key, keys[i]);
+            it = segment_for_key_from(it, k);
+            auto pos = this->predict(it, k);
+            auto lo = PGM_SUB_EPS(pos, Epsilon);
+            auto hi = PGM_ADD_EPS(pos, Epsilon, n);
+            out[i] = {pos, lo, hi};
+        }
+    }
+
     /**
      * Returns the number of segments in the last level of the index.
      * @return the number of segments
      */
-    size_t segments_count() const { return segments.empty() ? 0 : levels_offsets[1] - 1; }
+    size_t segments_count() const { return this->stored_count() == 0 ? 0 : levels_offsets[1] - 1; }
 
     /**
      * Returns the number of levels of the index.
@@ -218,49 +809,112 @@ public:
      * Returns the size of the index in bytes.
      * @return the size of the index in bytes
      */
-    size_t size_in_bytes() const { return segments.size() * sizeof(Segment) + levels_offsets.size() * sizeof(size_t); }
+    size_t size_in_bytes() const { return this->stored_bytes() + levels_offsets.size() * sizeof(size_t); }
+
+    /**
+     * Updates the state that depends on the addresses of the arrays of the index, after they have been moved to other
+     * memory, such as by @ref use_huge_pages. The index itself has no such state, but its variants may have.
+     */
+    void relocated() {}
 };
 
-#pragma pack(push, 1)
+/**
+ * Builds a @ref PGMIndex on a stream of sorted keys that are pushed one at a time.
+ *
+ * The keys are fed to the segmentation algorithm as they arrive, and the segments of the first level are emitted as
+ * soon as they are complete, so that the memory used by the builder is proportional to the number of segments rather
+ * than to the number of keys. The upper levels are built by @ref finish. The resulting index is the same that the
+ * constructor PGMIndex(first, last) would build on the sequence of pushed keys.
+ *
+ * @tparam K the type of the indexed keys
+ * @tparam Epsilon controls the size of the returned search range
+ * @tparam EpsilonRecursive controls the size of the search range in the internal structure
+ * @tparam Floating the floating-point type to use for slopes
+ */
+template<typename K, size_t Epsilon = 64, size_t EpsilonRecursive = 4, typename Floating = float>
+class PGMIndexBuilder {
+    using index_type = PGMIndex<K, Epsilon, EpsilonRecursive, Floating>;
+    using segment_type = typename index_type::Segment;
+
+    Segmenter<K, size_t> segmenter;     ///< The segmentation of the first level.
+    std::vector<segment_type> segments; ///< The completed segments of the first level.
+    size_t n = 0;                       ///< The number of keys pushed so far.
+    K first_key = 0;                    ///< The smallest key.
+    K previous_key = 0;                 ///< The key pushed before the pending one.
+    K pending_key = 0;                  ///< The last key pushed, not yet added to the segmentation.
+
+    void add_point(const K &x, size_t i) {
+        if (auto segment = segmenter.push(x, i))
+            segments.emplace_back(*segment);
+    }
 
-template<typename K, size_t Epsilon, size_t EpsilonRecursive, typename Floating>
-struct PGMIndex<K, Epsilon, EpsilonRecursive, Floating>::Segment {
-    K key;             ///< The first key that the segment indexes.
-    Floating slope;    ///< The slope of the segment.
-    int32_t intercept; ///< The intercept of the segment.
+public:
 
-    Segment() = default;
+    /**
+     * Constructs an empty builder.
+     */
+    PGMIndexBuilder() : segmenter(Epsilon) {}
 
-    Segment(K key, Floating slope, int32_t intercept) : key(key), slope(slope), intercept(intercept) {};
+    /**
+     * Appends a key to the sequence to be indexed.
+     * @param key the key to append, must not be less than the keys pushed before
+     */
+    void push(const K &key) {
+        if (n == 0) {
+            first_key = key;
+        } else {
+            // The point of the pending key depends on its successor, see internal::adjust_duplicate_key
+            auto i = n - 1;
+            add_point(i > 0 ? internal::adjust_duplicate_key(previous_key, pending_key, key) : pending_key, i);
+            previous_key = pending_key;
+        }
+        pending_key = key;
+        ++n;
+    }
 
-    explicit Segment(size_t n) : key(std::numeric_limits<K>::max()), slope(), intercept(n) {};
+    /**
+     * Builds the upper levels and returns the index on the keys pushed so far. The builder is left empty.
+     * @return the index on the pushed keys
+     */
+    index_type finish() {
+        index_type index;
+        index.n = n;
+        index.first_key = n ? first_key : K(0);
+        if (n == 0)
+            return index;
 
-    explicit Segment(const typename internal::OptimalPiecewiseLinearModel<K, size_t>::CanonicalSegment &cs)
-        : key(cs.get_first_x()) {
-        auto[cs_slope, cs_intercept] = cs.get_floating_point_segment(key);
-        if (cs_intercept > std::numeric_limits<decltype(intercept)>::max())
-            throw std::overflow_error("Change the type of Segment::intercept to int64");
-        slope = cs_slope;
-        intercept = cs_intercept;
+        auto ignore_last = pending_key == std::numeric_limits<K>::max(); // max() is the sentinel value
+        auto last_n = n - ignore_last;
+        if (!ignore_last)
+            add_point(pending_key, n - 1);
+        auto last_key = ignore_last ? previous_key : pending_key;
+
+        if (auto segment = segmenter.flush())
+            segments.emplace_back(*segment);
+        auto n_segments = segments.size();
+        std::vector<size_t> levels_offsets = {0};
+        last_n = index_type::close_level(n_segments, last_n, last_key, segments);
+        levels_offsets.push_back(last_n + 1);
+        index_type::build_upper_levels(last_n, last_key, EpsilonRecursive, segments, levels_offsets);
+        index.segments = std::move(segments);
+        index.levels_offsets = std::move(levels_offsets);
+
+        segments = {};
+        n = 0;
+        return index;
     }
 
-    friend inline bool operator<(const Segment &s, const K &k) { return s.key < k; }
-    friend inline bool operator<(const K &k, const Segment &s) { return k < s.key; }
-    friend inline bool operator<(const Segment &s, const Segment &t) { return s.key < t.key; }
-
-    operator K() { return key; };
+    /**
+     * Returns the number of keys pushed so far.
+     * @return the number of keys pushed so far
+     */
+    size_t size() const { return n; }
 
     /**
-     * Returns the approximate position of the specified key.
-     * @param k the key whose position must be approximated
-     * @return the approximate position of the specified key
+     * Returns the number of completed segments in the first level.
+     * @return the number of completed segments
      */
-    inline size_t operator()(const K &k) const {
-        auto pos = int64_t(slope * (k - key)) + intercept;
-        return pos > 0 ? size_t(pos) : 0ull;
-    }
+    size_t segments_count() const { return segments.size(); }
 };
 
-#pragma pack(pop)
-
 }
@@ -0,0 +1,460 @@
+// This file is part of PGM-index <https://github.com/gvinciguerra/PGM-index>.
+// Copyright (c) 2021 Giorgio Vinciguerra.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "pgm_index_dynamic.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace pgm {
+
+/**
+ * A variant of @ref DynamicPGMIndex that supports concurrent readers while the container is being updated.
+ *
+ * The levels never change once built. Each update builds a new table of levels, which shares the unchanged levels with
+ * the previous table, and publishes it with an atomic store. A reader takes a @ref Snapshot, which pins the current
+ * table without locking, and sees neither the updates nor the merges that follow. The tables that are replaced are
+ * freed by the writer when no snapshot pinned an epoch that is old enough to reach them (epoch-based reclamation).
+ *
+ * The updates are serialized by a mutex. Since the buffer level is copied by each update, an insertion allocates and
+ * writes O(buffer) items, whereas @ref DynamicPGMIndex moves O(buffer) items in place.
+ *
+ * @tparam K the type of a key
+ * @tparam V the type of a value
+ * @tparam PGMType the type of @ref PGMIndex to use in the container
+ * @tparam Search the last-mile search policy used on the windows returned by the indexes of the levels
+ */
+template<typename K, typename V, typename PGMType = PGMIndex<K, 16>, typename Search = BranchlessBinarySearch>
+class ConcurrentDynamicPGMIndex {
+    using base_type = DynamicPGMIndex<K, V, PGMType, Search>;
+    using Item = typename base_type::Item;
+    using Level = typename base_type::Level;
+
+    struct LevelData {
+        Level items; ///< The sorted items of the level.
+        PGMType pgm; ///< The index on the items, if the level is at least min_index_level.
+    };
+
+    struct Version {
+        uint8_t used_levels; ///< Equal to 1 + last level whose size is greater than 0, or = min_level if no data.
+        std::vector<std::shared_ptr<const LevelData>> levels; ///< (i-min_level)th element is the ith level, or null.
+    };
+
+    struct alignas(64) ReaderSlot {
+        std::atomic<uint64_t> epoch{0}; ///< The epoch pinned by the reader using this slot, or 0 if the slot is free.
+    };
+
+    const uint8_t base;            ///< base^i is the maximum size of the ith level.
+    const uint8_t min_level;       ///< Levels 0..min_level are combined into one large level.
+    const uint8_t min_index_level; ///< Minimum level on which an index is constructed.
+    size_t buffer_max_size;        ///< Size of the combined upper levels, i.e. max_size(0) + ... + max_size(min_level).
+    std::atomic<const Version *> current; ///< The most recent table of levels.
+    std::atomic<uint64_t> epoch;   ///< Incremented each time a table is replaced.
+    mutable std::array<ReaderSlot, 64> slots; ///< The epochs pinned by the readers.
+    std::mutex writer_mutex;       ///< Serializes the updates.
+    std::vector<std::pair<const Version *, uint64_t>> retired; ///< The replaced tables with the epoch of replacement.
+
+    size_t max_size(uint8_t level) const { return size_t(1) << (level * base_type::ceil_log2(base)); }
+    uint8_t ceil_log_base(size_t n) const {
+        return (base_type::ceil_log2(n) + base_type::ceil_log2(base) - 1) / base_type::ceil_log2(base);
+    }
+
+    /** Publishes the table @p next, which is owned by the container from now on, and frees the unreachable ones. */
+    void publish(const Version *next, bool merged) {
+        auto previous = current.exchange(next);
+        retired.emplace_back(previous, epoch.fetch_add(1));
+        if (merged || retired.size() >= slots.size())
+            reclaim();
+    }
+
+    /** Frees the replaced tables that no reader can reach, i.e. those replaced before every pinned epoch. */
+    void reclaim() {
+        auto min_pinned = std::numeric_limits<uint64_t>::max();
+        for (auto &s : slots) {
+            auto e = s.epoch.load();
+            if (e != 0)
+                min_pinned = std::min(min_pinned, e);
+        }
+
+        auto it = retired.begin();
+        for (; it != retired.end() && it->second < min_pinned; ++it)
+            delete it->first;
+        retired.erase(retired.begin(), it);
+    }
+
+    void insert(const Item &new_item) {
+        std::lock_guard<std::mutex> lock(writer_mutex);
+        auto v = current.load();
+        auto next = std::make_unique<Version>(*v);
+        auto buffer = v->levels[0] ? &v->levels[0]->items : nullptr;
+        auto buffer_size = buffer ? buffer->size() : 0;
+        auto insertion_point = buffer ? internal::branchless_lower_bound(buffer->begin(), buffer->end(), new_item)
+                                      : typename Level::const_iterator();
+        auto found = buffer && insertion_point != buffer->end() && *insertion_point == new_item;
+
+        if (found || buffer_size < buffer_max_size) {
+            auto data = std::make_shared<LevelData>();
+            data->items.reserve(buffer_size + !found);
+            if (buffer)
+                data->items.insert(data->items.end(), buffer->begin(), insertion_point);
+            data->items.push_back(new_item);
+            if (buffer)
+                data->items.insert(data->items.end(), insertion_point + found, buffer->end());
+            next->levels[0] = std::move(data);
+            next->used_levels = std::max<uint8_t>(next->used_levels, min_level + 1);
+            publish(next.release(), false);
+            return;
+        }
+
+        size_t slots_required = buffer_max_size + 1;
+        uint8_t i;
+        for (i = min_level + 1; i < next->used_levels; ++i) {
+            auto level_size = next->levels[i - min_level] ? next->levels[i - min_level]->items.size() : 0;
+            if (slots_required <= max_size(i) - level_size)
+                break;
+            slots_required += level_size;
+        }
+
+        if (i == next->used_levels) {
+            ++next->used_levels;
+            next->levels.resize(std::max<size_t>(next->levels.size(), i - min_level + 1));
+        }
+
+        // Merge the buffer and the new item with the levels up to the target, as in DynamicPGMIndex::pairwise_merge
+        auto &target = next->levels[i - min_level];
+        auto target_size = target ? target->items.size() : 0;
+        Level tmp_a(slots_required + target_size);
+        Level tmp_b(slots_required + target_size);
+        auto alternate = true;
+        auto it = std::copy(buffer->begin(), insertion_point, tmp_a.begin());
+        *it++ = new_item;
+        it = std::copy(insertion_point, buffer->end(), it);
+        auto tmp_size = std::distance(tmp_a.begin(), it);
+
+        uint8_t merge_limit = target ? i : i - 1;
+        for (uint8_t j = 1 + min_level; j <= merge_limit; ++j) {
+            auto &level = next->levels[j - min_level];
+            if (!level)
+                continue;
+
+            auto tmp_begin = (alternate ? tmp_a : tmp_b).begin();
+            auto tmp_end = tmp_begin + tmp_size;
+            auto out_begin = (alternate ? tmp_b : tmp_a).begin();
+            auto &items = level->items;
+            decltype(out_begin) out_end;
+
+            if (j == next->used_levels - 1)
+                out_end = base_type::template merge<true, false>(tmp_begin, tmp_end, items.begin(), items.end(),
+                                                                 out_begin);
+            else
+                out_end = base_type::template merge<false, false>(tmp_begin, tmp_end, items.begin(), items.end(),
+                                                                  out_begin);
+            tmp_size = std::distance(out_begin, out_end);
+            alternate = !alternate;
+            level = nullptr;
+        }
+
+        auto data = std::make_shared<LevelData>();
+        data->items = std::move(alternate ? tmp_a : tmp_b);
+        data->items.resize(tmp_size);
+        if (i >= min_index_level)
+            data->pgm = PGMType(data->items.begin(), data->items.end());
+        next->levels[0] = nullptr;
+        target = std::move(data);
+        publish(next.release(), true);
+    }
+
+public:
+
+    class Snapshot;
+
+    using key_type = K;
+    using mapped_type = V;
+    using value_type = Item;
+    using size_type = size_t;
+
+    /**
+     * Constructs an empty container.
+     * @param base determines the size of the ith level as base^i
+     * @param buffer_level determines the size of level 0, equal to the sum of base^i for i = 0, ..., buffer_level
+     * @param index_level the minimum level at which an index is constructed to speed up searches
+     */
+    ConcurrentDynamicPGMIndex(uint8_t base = 8, uint8_t buffer_level = 0, uint8_t index_level = 0)
+        : base(base),
+          min_level(buffer_level ? buffer_level : ceil_log_base(128) - (base == 2)),
+          min_index_level(std::max<size_t>(min_level + 1, index_level ? index_level : ceil_log_base(size_t(1) << 24))),
+          buffer_max_size(),
+          current(),
+          epoch(1),
+          slots(),
+          writer_mutex(),
+          retired() {
+        if (base < 2 || (base & (base - 1u)) != 0)
+            throw std::invalid_argument("base must be a power of two");
+
+        for (auto j = 0; j <= min_level; ++j)
+            buffer_max_size += max_size(j);
+
+        auto v = new Version();
+        v->used_levels = min_level;
+        v->levels.resize(1);
+        current = v;
+    }
+
+    /**
+     * Constructs the container on the sorted data in the range [first, last).
+     * @tparam Iterator
+     * @param first, last the range containing the sorted elements to be indexed
+     * @param base determines the size of the ith level as base^i
+     * @param buffer_level determines the size of level 0, equal to the sum of base^i for i = 0, ..., buffer_level
+     * @param index_level the minimum level at which an index is constructed to speed up searches
+     */
+    template<typename Iterator>
+    ConcurrentDynamicPGMIndex(Iterator first, Iterator last, uint8_t base = 8, uint8_t buffer_level = 0,
+                              uint8_t index_level = 0)
+        : ConcurrentDynamicPGMIndex(base, buffer_level, index_level) {
+        if (first == last)
+            return;
+
+        // Copy only the first of each group of pairs with same key value
+        auto data = std::make_shared<LevelData>();
+        data->items.reserve(std::distance(first, last));
+        data->items.emplace_back(first->first, first->second);
+        while (++first != last) {
+            if (first->first < data->items.back().first)
+                throw std::invalid_argument("Range is not sorted");
+            if (first->first != data->items.back().first)
+                data->items.emplace_back(first->first, first->second);
+        }
+
+        auto v = std::make_unique<Version>();
+        v->used_levels = std::max<uint8_t>(ceil_log_base(data->items.size()), min_level) + 1;
+        v->levels.resize(v->used_levels - min_level);
+        if (v->used_levels - 1 >= min_index_level)
+            data->pgm = PGMType(data->items.begin(), data->items.end());
+        v->levels.back() = std::move(data);
+        delete current.exchange(v.release());
+    }
+
+    ConcurrentDynamicPGMIndex(const ConcurrentDynamicPGMIndex &) = delete;
+    ConcurrentDynamicPGMIndex &operator=(const ConcurrentDynamicPGMIndex &) = delete;
+
+    /** Destroys the container, which must not have live snapshots. */
+    ~ConcurrentDynamicPGMIndex() {
+        for (auto &r : retired)
+            delete r.first;
+        delete current.load();
+    }
+
+    /**
+     * Inserts an element into the container if @p key does not exists in the container. If @p key already exists, the
+     * corresponding value is updated with @p value. The readers see the update in the snapshots taken afterwards.
+     * @param key element key to insert or update
+     * @param value element value to insert
+     */
+    void insert_or_assign(const K &key, const V &value) { insert(Item(key, value)); }
+
+    /**
+     * Removes the specified element from the container.
+     * @param key key value of the element to remove
+     */
+    void erase(const K &key) { insert(Item(key)); }
+
+    /**
+     * Takes a snapshot of the container. This never blocks, unless more than 64 snapshots are alive at the same time.
+     * The replaced levels are not freed while the snapshot is alive, thus snapshots should be short-lived.
+     * @return a view of the container as of now
+     */
+    Snapshot snapshot() const {
+        auto h = std::hash<std::thread::id>()(std::this_thread::get_id());
+        for (size_t i = 0;; ++i) {
+            auto &slot = slots[(h + i) % slots.size()];
+            uint64_t expected = 0;
+            auto free = slot.epoch.load(std::memory_order_relaxed) == 0;
+            if (free && slot.epoch.compare_exchange_strong(expected, epoch.load()))
+                return Snapshot(this, &slot, current.load());
+            if (i % slots.size() == slots.size() - 1)
+                std::this_thread::yield();
+        }
+    }
+
+    /**
+     * Finds the value of the element with key equivalent to @p key.
+     * @param key key value of the element to search for
+     * @return the value of the element, or an empty optional if no such element is found
+     */
+    std::optional<V> find(const K &key) const {
+        auto s = snapshot();
+        auto it = s.find(key);
+        return it ? std::optional<V>(it->second) : std::nullopt;
+    }
+
+    /**
+     * Returns a copy of the elements with key between and including @p lo and @p hi.
+     * @param lo lower endpoint of the range query
+     * @param hi upper endpoint of the range query, must be greater than or equal to @p lo
+     * @return a vector of key-value pairs satisfying the range query
+     */
+    std::vector<std::pair<K, V>> range(const K &lo, const K &hi) const { return snapshot().range(lo, hi); }
+};
+
+/**
+ * A consistent, read-only view of a @ref ConcurrentDynamicPGMIndex, which may be used by one thread at a time.
+ */
+template<typename K, typename V, typename PGMType, typename Search>
+class ConcurrentDynamicPGMIndex<K, V, PGMType, Search>::Snapshot {
+    friend class ConcurrentDynamicPGMIndex;
+
+    const ConcurrentDynamicPGMIndex *super; ///< Pointer to the container.
+    ReaderSlot *slot;                       ///< The slot holding the epoch pinned by this snapshot.
+    const Version *version;                 ///< The table of levels seen by this snapshot.
+
+    Snapshot(const ConcurrentDynamicPGMIndex *super, ReaderSlot *slot, const Version *version)
+        : super(super), slot(slot), version(version) {}
+
+    /** Calls f(i, level) on each non-empty level from the most recent, until f returns true. */
+    template<typename F>
+    void for_each_level(F f) const {
+        for (uint8_t i = super->min_level; i < version->used_levels; ++i)
+            if (auto &l = version->levels[i - super->min_level]; l && f(i, *l))
+                return;
+    }
+
+    typename Level::const_iterator search_level(uint8_t i, const LevelData &l, const K &key) const {
+        if (i >= super->min_index_level)
+            return internal::search_range<Search>(l.items.begin(), l.pgm.search(key), key);
+        return internal::branchless_lower_bound(l.items.begin(), l.items.end(), key);
+    }
+
+public:
+
+    Snapshot(const Snapshot &) = delete;
+    Snapshot &operator=(const Snapshot &) = delete;
+    Snapshot(Snapshot &&other) noexcept : super(other.super), slot(other.slot), version(other.version) {
+        other.slot = nullptr;
+    }
+
+    ~Snapshot() {
+        if (slot)
+            slot->epoch.store(0, std::memory_order_release);
+    }
+
+    /**
+     * Finds an element with key equivalent to @p key.
+     * @param key key value of the element to search for
+     * @return a pointer to the element, valid while the snapshot is alive, or nullptr if no such element is found
+     */
+    const value_type *find(const K &key) const {
+        const value_type *result = nullptr;
+        for_each_level([&](uint8_t i, const LevelData &l) {
+            auto it = search_level(i, l, key);
+            if (it == l.items.end() || it->first != key)
+                return false;
+            result = it->deleted() ? nullptr : &*it;
+            return true;
+        });
+        return result;
+    }
+
+    /**
+     * Returns the first element that is not less than (i.e. greater or equal to) @p key.
+     * @param key key value to compare the elements to
+     * @return a pointer to the element, valid while the snapshot is alive, or nullptr if no such element is found
+     */
+    const value_type *lower_bound(const K &key) const {
+        const value_type *lb = nullptr;
+        std::set<K> deleted;
+
+        for_each_level([&](uint8_t i, const LevelData &l) {
+            for (auto it = search_level(i, l, key); it != l.items.end() && (!lb || it->first < lb->first); ++it) {
+                if (it->deleted())
+                    deleted.emplace(it->first);
+                else if (deleted.find(it->first) == deleted.end()) {
+                    lb = &*it;
+                    return it->first == key;
+                }
+            }
+            return false;
+        });
+
+        return lb;
+    }
+
+    /**
+     * Returns a copy of the elements with key between and including @p lo and @p hi.
+     * @param lo lower endpoint of the range query
+     * @param hi upper endpoint of the range query, must be greater than or equal to @p lo
+     * @return a vector of key-value pairs satisfying the range query
+     */
+    std::vector<std::pair<K, V>> range(const K &lo, const K &hi) const {
+        if (lo > hi)
+            throw std::invalid_argument("lo > hi");
+
+        Level tmp_a;
+        Level tmp_b;
+        auto alternate = true;
+
+        for_each_level([&](uint8_t i, const LevelData &l) {
+            auto it_lo = search_level(i, l, lo);
+            auto it_hi = std::upper_bound(it_lo, l.items.end(), hi);
+            auto range_size = std::distance(it_lo, it_hi);
+            if (range_size == 0)
+                return false;
+
+            auto tmp_size = (alternate ? tmp_a : tmp_b).size();
+            (alternate ? tmp_b : tmp_a).resize(tmp_size + range_size);
+            auto tmp_it = (alternate ? tmp_a : tmp_b).begin();
+            auto out_it = (alternate ? tmp_b : tmp_a).begin();
+            tmp_size = std::distance(out_it,
+                                     base_type::template merge<false, false>(tmp_it, tmp_it + tmp_size, it_lo, it_hi,
+                                                                             out_it));
+            (alternate ? tmp_b : tmp_a).resize(tmp_size);
+            alternate = !alternate;
+            return false;
+        });
+
+        std::vector<std::pair<K, V>> result;
+        result.reserve((alternate ? tmp_a : tmp_b).size());
+        for (auto &item : alternate ? tmp_a : tmp_b)
+            if (!item.deleted())
+                result.emplace_back(item.first, item.second);
+        return result;
+    }
+
+    /**
+     * Returns the number of elements in the snapshot.
+     * @return the number of elements in the snapshot
+     */
+    size_t size() const {
+        return range(std::numeric_limits<K>::min(), std::numeric_limits<K>::max()).size();
+    }
+};
+
+}
@@ -16,44 +16,156 @@
 #pragma once
 
 #include "pgm_index.hpp"
+#include "pgm_search.hpp"
 #include <cstddef>
 #include <cstdint>
 #include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <functional>
 #include <iterator>
 #include <limits>
 #include <memory>
+#include <mutex>
 #include <new>
 #include <set>
 #include <stdexcept>
+#include <thread>
 #include <type_traits>
 #include <utility>
 #include <vector>
 
 namespace pgm {
 
+template<typename K, typename V, typename PGMType, typename Search>
+class ConcurrentDynamicPGMIndex;
+
+namespace internal {
+
+/** Returns a 64-bit hash of @p key, such that keys that compare equal have the same hash. */
+template<typename K>
+uint64_t hash_key(const K &key) {
+    auto mix = [](uint64_t x) {
+        x ^= x >> 33;
+        x *= 0xff51afd7ed558ccdULL;
+        x ^= x >> 33;
+        x *= 0xc4ceb9fe1a85ec53ULL;
+        return x ^ (x >> 33);
+    };
+
+    // Hash the bytes only if equal keys have equal bytes, which excludes padding (as in long double) and ±0 floats
+    if constexpr (std::has_unique_object_representations_v<K> && sizeof(K) <= 16) {
+        uint64_t words[2] = {};
+        std::memcpy(words, &key, sizeof(K));
+        return mix(words[0] ^ mix(words[1]));
+    } else
+        return mix(std::hash<K>()(key));
+}
+
+/**
+ * A split block Bloom filter, which sets 8 bits of a 256-bit block for each key, so that a query touches one cache
+ * line. With 10 bits per key, the false positive rate is about 1%.
+ */
+class BlockedBloomFilter {
+    struct alignas(32) Block {
+        uint32_t words[8];
+    };
+
+    std::vector<Block> blocks;
+
+    static uint32_t bit(uint32_t h, size_t i) {
+        constexpr static uint32_t salts[8] = {0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU,
+                                              0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U};
+        return uint32_t(1) << ((h * salts[i]) >> 27);
+    }
+
+    size_t block_index(uint64_t h) const { return (uint64_t(uint32_t(h >> 32)) * blocks.size()) >> 32; }
+
+public:
+
+    BlockedBloomFilter() = default;
+
+    /**
+     * Constructs the filter on the keys of the items in the range [first, last).
+     * @param bits_per_key the number of bits of the filter for each key
+     */
+    template<typename RandomIt>
+    BlockedBloomFilter(RandomIt first, RandomIt last, size_t bits_per_key)
+        : blocks(std::max<size_t>(1, (std::distance(first, last) * bits_per_key + 255) / 256)) {
+        for (auto it = first; it != last; ++it) {
+            auto h = hash_key(it->first);
+            auto &b = blocks[block_index(h)];
+            for (size_t i = 0; i < 8; ++i)
+                b.words[i] |= bit(uint32_t(h), i);
+        }
+    }
+
+    /**
+     * Checks whether a key with the given hash may have been inserted in the filter. An empty filter has no keys.
+     * @param h the hash of the key, computed with @ref hash_key
+     * @return false if the key is surely not in the filter, true otherwise
+     */
+    bool may_contain(uint64_t h) const {
+        if (blocks.empty())
+            return true;
+        auto &b = blocks[block_index(h)];
+        auto result = true;
+        for (size_t i = 0; i < 8; ++i)
+            result &= (b.words[i] & bit(uint32_t(h), i)) != 0;
+        return result;
+    }
+
+    /**
+     * Returns the size of the filter in bytes.
+     * @return the size of the filter in bytes
+     */
+    size_t size_in_bytes() const { return blocks.size() * sizeof(Block); }
+};
+
+} // namespace internal
+
 /**
  * A sorted associative container that contains key-value pairs with unique keys.
+ *
+ * By default, an insertion that fills the buffer level merges it with the following levels before returning. After a
+ * call to @ref enable_background_merges, a full buffer is instead frozen and merged by a background thread, while the
+ * insertions continue on an empty buffer.
+ *
  * @tparam K the type of a key
  * @tparam V the type of a value
  * @tparam PGMType the type of @ref PGMIndex to use in the container
+ * @tparam Search the last-mile search policy used on the windows returned by the indexes of the levels
+ * @tparam Allocator the allocator of the levels, such as @ref HugePageAllocator, which is rebound to the item type
  */
-template<typename K, typename V, typename PGMType = PGMIndex<K, 16>>
+template<typename K, typename V, typename PGMType = PGMIndex<K, 16>, typename Search = BranchlessBinarySearch,
+    typename Allocator = std::allocator<std::pair<K, V>>>
 class DynamicPGMIndex {
     class ItemA;
     class ItemB;
     class Iterator;
+    class RangeCursor;
+    class Compactor;
+
+    template<typename, typename, typename, typename>
+    friend class ConcurrentDynamicPGMIndex;
 
     using Item = std::conditional_t<std::is_pointer_v<V> || std::is_arithmetic_v<V>, ItemA, ItemB>;
-    using Level = std::vector<Item>;
+    using Level = std::vector<Item, typename std::allocator_traits<Allocator>::template rebind_alloc<Item>>;
 
     const uint8_t base;            ///< base^i is the maximum size of the ith level.
     const uint8_t min_level;       ///< Levels 0..min_level are combined into one large level.
     const uint8_t min_index_level; ///< Minimum level on which an index is constructed.
+    const uint8_t filter_bits;     ///< Bits per key of the filters on the levels below the buffer, 0 if no filters.
     size_t buffer_max_size;        ///< Size of the combined upper levels, i.e. max_size(0) + ... + max_size(min_level).
     uint8_t used_levels;           ///< Equal to 1 + last level whose size is greater than 0, or = min_level if no data.
     std::vector<Level> levels;     ///< (i-min_level)th element is the data array at the ith level.
     std::vector<PGMType> pgms;     ///< (i-min_index_level)th element is the index at the ith level.
+    std::vector<internal::BlockedBloomFilter> filters; ///< (i-min_level)th element is the filter on the ith level.
+    std::deque<Level> frozen;      ///< Full buffers waiting to be merged in background, from the oldest.
+    std::unique_ptr<Compactor> compactor; ///< The background merges, if enabled. Destroyed first, as it reads levels.
 
     const Level &level(uint8_t level) const { return levels[level - min_level]; }
     const PGMType &pgm(uint8_t level) const { return pgms[level - min_index_level]; }
@@ -65,23 +177,75 @@ class DynamicPGMIndex {
     uint8_t ceil_log_base(size_t n) const { return (ceil_log2(n) + ceil_log2(base) - 1) / ceil_log2(base); }
     constexpr static uint8_t ceil_log2(size_t n) { return n <= 1 ? 0 : sizeof(long long) * 8 - __builtin_clzll(n - 1); }
 
+    /**
+     * Calls f(i, level) on each non-empty level from the most recent, until f returns true. The frozen buffers come
+     * after the buffer and are numbered min_level like it.
+     * @return true if f returned true
+     */
+    template<typename F>
+    bool for_each_level(F f) const {
+        if (!level(min_level).empty() && f(min_level, level(min_level)))
+            return true;
+        for (auto it = frozen.rbegin(); it != frozen.rend(); ++it)
+            if (f(min_level, *it))
+                return true;
+        for (auto i = min_level + 1; i < used_levels; ++i)
+            if (!level(i).empty() && f(uint8_t(i), level(i)))
+                return true;
+        return false;
+    }
+
+    /** Replaces the filter on the ith level with @p filter, or with an empty one if the level is empty. */
+    void set_filter(uint8_t i, internal::BlockedBloomFilter &&filter = {}) {
+        if (filters.size() <= size_t(i - min_level))
+            filters.resize(i - min_level + 1);
+        filters[i - min_level] = std::move(filter);
+    }
+
+    /** Returns false if the ith level surely does not contain the key with hash @p h. */
+    bool may_contain(uint8_t i, uint64_t h) const {
+        return size_t(i - min_level) >= filters.size() || filters[i - min_level].may_contain(h);
+    }
+
+    internal::BlockedBloomFilter make_filter(const Level &l) const {
+        if (filter_bits == 0)
+            return {};
+        return internal::BlockedBloomFilter(l.begin(), l.end(), filter_bits);
+    }
+
     void pairwise_merge(const Item &new_item,
                         uint8_t target,
                         size_t size_hint,
                         typename Level::iterator insertion_point) {
         Level tmp_a(size_hint + level(target).size());
-        Level tmp_b(size_hint + level(target).size());
 
         // Insert new_item in sorted order in the first level
-        auto alternate = true;
         auto it = std::move(level(min_level).begin(), insertion_point, tmp_a.begin());
         *it++ = new_item;
         it = std::move(insertion_point, level(min_level).end(), it);
         auto tmp_size = std::distance(tmp_a.begin(), it);
+        level(min_level).clear();
+
+        merge_into(target, tmp_a, tmp_size);
+    }
+
+    /**
+     * Merges the first @p tmp_size items of @p tmp_a, which are more recent than the levels, with the levels
+     * min_level+1, ..., @p target, and moves the result to the level @p target, whose index is rebuilt.
+     * @param tmp_a a buffer large enough to hold the result, whose content is moved away
+     */
+    void merge_into(uint8_t target, Level &tmp_a, size_t tmp_size) {
+        Level tmp_b;
+        auto alternate = true;
 
-        // Merge subsequent levels
+        // Merge subsequent levels, skipping the empty ones
         uint8_t merge_limit = level(target).empty() ? target - 1 : target;
-        for (uint8_t i = 1 + min_level; i <= merge_limit; ++i, alternate = !alternate) {
+        for (uint8_t i = 1 + min_level; i <= merge_limit; ++i) {
+            if (level(i).empty())
+                continue;
+            if (tmp_b.empty())
+                tmp_b = Level(tmp_a.size());
+
             auto tmp_begin = (alternate ? tmp_a : tmp_b).begin();
             auto tmp_end = tmp_begin + tmp_size;
             auto out_begin = (alternate ? tmp_b : tmp_a).begin();
@@ -100,19 +264,25 @@ class DynamicPGMIndex {
                 level(i).shrink_to_fit();
             if (has_pgm(i))
                 pgm(i) = PGMType();
+            set_filter(i);
+            alternate = !alternate;
         }
 
-        level(min_level).clear();
         level(target) = std::move(alternate ? tmp_a : tmp_b);
         level(target).resize(tmp_size);
 
-        // Rebuild index, if needed
+        // Rebuild index and filter, if needed
         if (has_pgm(target))
             pgm(target) = PGMType(level(target).begin(), level(target).end());
+        set_filter(target, make_filter(level(target)));
     }
 
     void insert(const Item &new_item) {
-        auto insertion_point = lower_bound_bl(level(min_level).begin(), level(min_level).end(), new_item);
+        if (compactor && compactor->completed)
+            install_merged_level(false);
+
+        auto insertion_point = internal::branchless_lower_bound(level(min_level).begin(), level(min_level).end(),
+                                                                new_item);
         if (insertion_point != level(min_level).end() && *insertion_point == new_item) {
             *insertion_point = new_item;
             return;
@@ -124,6 +294,12 @@ class DynamicPGMIndex {
             return;
         }
 
+        if (compactor) {
+            freeze_buffer();
+            level(min_level).push_back(new_item);
+            return;
+        }
+
         size_t slots_required = buffer_max_size + 1;
         uint8_t i;
         for (i = min_level + 1; i < used_levels; ++i) {
@@ -144,6 +320,120 @@ class DynamicPGMIndex {
         pairwise_merge(new_item, i, slots_required, insertion_point);
     }
 
+    /** Moves the full buffer to the frozen ones, waiting for the background merges if too many are frozen. */
+    void freeze_buffer() {
+        while (frozen.size() >= compactor->max_frozen_runs)
+            install_merged_level(true);
+        frozen.push_back(std::move(level(min_level)));
+        level(min_level) = Level();
+        level(min_level).reserve(buffer_max_size);
+        install_merged_level(false);
+    }
+
+    /**
+     * Installs the level merged in background, if any, and hands the frozen buffers to the background thread, if it
+     * is idle. This is the only place where the levels change in background mode, so that readers in the thread of
+     * the caller always see either the frozen buffers and the old levels, or the new levels.
+     * @param wait whether to wait for the merge in progress, if any
+     */
+    void install_merged_level(bool wait) {
+        auto &c = *compactor;
+        std::unique_lock<std::mutex> lock(c.mutex);
+        if (wait)
+            c.merged_cv.wait(lock, [&] { return c.completed || !c.pending; });
+
+        if (c.completed) {
+            auto &job = c.job;
+            for (uint8_t i = min_level + 1; i <= job.merge_limit; ++i) {
+                level(i).clear();
+                if (i >= max_fully_allocated_level())
+                    level(i).shrink_to_fit();
+                if (has_pgm(i))
+                    pgm(i) = PGMType();
+                set_filter(i);
+            }
+            level(job.target) = std::move(c.merged);
+            if (has_pgm(job.target))
+                pgm(job.target) = std::move(c.merged_pgm);
+            set_filter(job.target, std::move(c.merged_filter));
+            frozen.erase(frozen.begin(), frozen.begin() + job.runs.size());
+            c.completed = false;
+        }
+
+        if (c.pending || frozen.empty())
+            return;
+
+        // Find the target level as in insert(), adding the levels needed to hold the frozen buffers
+        auto &job = c.job;
+        size_t slots_required = 0;
+        for (auto &run : frozen)
+            slots_required += run.size();
+        uint8_t i;
+        for (i = min_level + 1; i < used_levels; ++i) {
+            auto slots_left_in_level = max_size(i) - level(i).size();
+            if (slots_required <= slots_left_in_level)
+                break;
+            slots_required += level(i).size();
+        }
+        while (i == used_levels && max_size(i) < slots_required)
+            ++i;
+        while (used_levels <= i) {
+            ++used_levels;
+            levels.emplace_back();
+        }
+        if (has_pgm(i) && pgms.size() <= size_t(i - min_index_level))
+            pgms.resize(i - min_index_level + 1);
+
+        job.runs.clear();
+        for (auto it = frozen.rbegin(); it != frozen.rend(); ++it)
+            job.runs.push_back(&*it);
+        job.levels.clear();
+        job.target = i;
+        job.merge_limit = level(i).empty() ? i - 1 : i;
+        for (uint8_t j = min_level + 1; j <= job.merge_limit; ++j)
+            job.levels.push_back(&level(j));
+        job.last_is_oldest = job.merge_limit == used_levels - 1;
+        job.build_pgm = has_pgm(i);
+        job.filter_bits = filter_bits;
+        job.size_hint = slots_required + level(i).size();
+        c.pending = true;
+        c.job_cv.notify_one();
+    }
+
+    /**
+     * Merges the given runs, from the most recent, with the given levels, which are all older than the runs.
+     * @param last_is_oldest whether the deleted items can be dropped when merging the last level
+     * @return the merged level
+     */
+    static Level merge_runs(const std::vector<const Level *> &runs, const std::vector<const Level *> &levels,
+                            bool last_is_oldest, size_t size_hint) {
+        Level tmp_a(size_hint);
+        Level tmp_b(size_hint);
+        auto alternate = true;
+        auto tmp_size = std::distance(tmp_a.begin(), std::copy(runs[0]->begin(), runs[0]->end(), tmp_a.begin()));
+
+        auto merge_with = [&](const Level &l, bool skip_deleted) {
+            auto tmp_begin = (alternate ? tmp_a : tmp_b).begin();
+            auto out_begin = (alternate ? tmp_b : tmp_a).begin();
+            decltype(out_begin) out_end;
+            if (skip_deleted)
+                out_end = merge<true, false>(tmp_begin, tmp_begin + tmp_size, l.begin(), l.end(), out_begin);
+            else
+                out_end = merge<false, false>(tmp_begin, tmp_begin + tmp_size, l.begin(), l.end(), out_begin);
+            tmp_size = std::distance(out_begin, out_end);
+            alternate = !alternate;
+        };
+
+        for (size_t i = 1; i < runs.size(); ++i)
+            merge_with(*runs[i], false);
+        for (size_t i = 0; i < levels.size(); ++i)
+            merge_with(*levels[i], last_is_oldest && i + 1 == levels.size());
+
+        auto &result = alternate ? tmp_a : tmp_b;
+        result.resize(tmp_size);
+        return std::move(result);
+    }
+
 public:
 
     using key_type = K;
@@ -157,15 +447,19 @@ public:
      * @param base determines the size of the ith level as base^i
      * @param buffer_level determines the size of level 0, equal to the sum of base^i for i = 0, ..., buffer_level
      * @param index_level the minimum level at which an index is constructed to speed up searches
+     * @param filter_bits the bits per key of the Bloom filters that let find() skip the levels without the key, or 0
+     *                    to use no filters
      */
-    DynamicPGMIndex(uint8_t base = 8, uint8_t buffer_level = 0, uint8_t index_level = 0)
+    DynamicPGMIndex(uint8_t base = 8, uint8_t buffer_level = 0, uint8_t index_level = 0, uint8_t filter_bits = 10)
         : base(base),
           min_level(buffer_level ? buffer_level : ceil_log_base(128) - (base == 2)),
           min_index_level(std::max<size_t>(min_level + 1, index_level ? index_level : ceil_log_base(size_t(1) << 24))),
+          filter_bits(filter_bits),
           buffer_max_size(),
           used_levels(min_level),
           levels(),
-          pgms() {
+          pgms(),
+          filters() {
         if (base < 2 || (base & (base - 1u)) != 0)
             throw std::invalid_argument("base must be a power of two");
 
@@ -185,10 +479,13 @@ public:
      * @param base determines the size of the ith level as base^i
      * @param buffer_level determines the size of level 0, equal to the sum of base^i for i = 0, ..., buffer_level
      * @param index_level the minimum level at which an index is constructed to speed up searches
+     * @param filter_bits the bits per key of the Bloom filters that let find() skip the levels without the key, or 0
+     *                    to use no filters
      */
-    template<typename Iterator>
-    DynamicPGMIndex(Iterator first, Iterator last, uint8_t base = 8, uint8_t buffer_level = 0, uint8_t index_level = 0)
-        : DynamicPGMIndex(base, buffer_level, index_level) {
+    template<typename Iterator, typename = std::enable_if_t<!std::is_integral_v<Iterator>>>
+    DynamicPGMIndex(Iterator first, Iterator last, uint8_t base = 8, uint8_t buffer_level = 0, uint8_t index_level = 0,
+                    uint8_t filter_bits = 10)
+        : DynamicPGMIndex(base, buffer_level, index_level, filter_bits) {
         size_t n = std::distance(first, last);
         used_levels = std::max<uint8_t>(ceil_log_base(n), min_level) + 1;
         levels.resize(std::max<uint8_t>(used_levels, 32) - min_level + 1);
@@ -218,8 +515,36 @@ public:
             pgms = decltype(pgms)(used_levels - min_index_level);
             pgm(used_levels - 1) = PGMType(target.begin(), target.end());
         }
+        set_filter(used_levels - 1, make_filter(target));
     }
 
+    /**
+     * Constructs a copy of @p other. The copy merges its levels synchronously, even if @p other has background merges
+     * enabled.
+     * @param other the container to copy, which must have no frozen buffers waiting to be merged
+     */
+    DynamicPGMIndex(const DynamicPGMIndex &other)
+        : base(other.base),
+          min_level(other.min_level),
+          min_index_level(other.min_index_level),
+          filter_bits(other.filter_bits),
+          buffer_max_size(other.buffer_max_size),
+          used_levels(other.used_levels),
+          levels(other.levels),
+          pgms(other.pgms),
+          filters(other.filters),
+          frozen(),
+          compactor() {
+        if (!other.frozen.empty())
+            throw std::invalid_argument("Call wait_merges() before copying a container with background merges");
+
+        level(min_level).reserve(buffer_max_size);
+        for (uint8_t i = min_level + 1; i < max_fully_allocated_level(); ++i)
+            level(i).reserve(max_size(i));
+    }
+
+    DynamicPGMIndex(DynamicPGMIndex &&) = default;
+
     /**
      * Inserts an element into the container if @p key does not exists in the container. If @p key already exists, the
      * corresponding value is updated with @p value.
@@ -235,29 +560,117 @@ public:
     void erase(const K &key) { insert(Item(key)); }
 
     /**
-     * Finds an element with key equivalent to @p key.
-     * @param key key value of the element to search for
-     * @return an iterator to an element with key equivalent to @p key. If no such element is found, end() is returned
+     * Inserts the elements in the range [first, last) into the container, or updates the values of their keys that
+     * already exist in the container. The effect is the same as calling insert_or_assign on each element in order,
+     * but the elements are merged with the buffer and the levels all at once, into the smallest level that can hold
+     * them, and only the index of that level is rebuilt.
+     * @tparam Iterator
+     * @param first, last the range containing the key-value pairs to insert, not necessarily sorted by key
      */
-    iterator find(const K &key) const {
-        for (auto i = min_level; i < used_levels; ++i) {
-            if (level(i).empty())
+    template<typename Iterator>
+    void insert_bulk(Iterator first, Iterator last) {
+        if (first == last)
+            return;
+        wait_merges();
+
+        Level batch;
+        batch.reserve(std::distance(first, last));
+        for (; first != last; ++first)
+            batch.emplace_back(first->first, first->second);
+        auto by_key = [](const Item &a, const Item &b) { return a.first < b.first; };
+        if (!std::is_sorted(batch.begin(), batch.end(), by_key))
+            std::stable_sort(batch.begin(), batch.end(), by_key);
+
+        // Copy only the last of each group of items with same key, as it is the most recent
+        auto out = batch.begin();
+        for (auto it = batch.begin(); it != batch.end(); ++it) {
+            if (std::next(it) != batch.end() && std::next(it)->first == it->first)
                 continue;
+            if (out != it)
+                *out = std::move(*it);
+            ++out;
+        }
+        batch.erase(out, batch.end());
+
+        auto &buffer = level(min_level);
+        size_t slots_required = batch.size() + buffer.size();
+        if (slots_required <= buffer_max_size) {
+            Level tmp(slots_required);
+            auto tmp_end = merge<false, true>(batch.begin(), batch.end(), buffer.begin(), buffer.end(), tmp.begin());
+            buffer.clear();
+            std::move(tmp.begin(), tmp_end, std::back_inserter(buffer));
+            used_levels = std::max<uint8_t>(used_levels, min_level + 1);
+            return;
+        }
 
-            auto first = level(i).begin();
-            auto last = level(i).end();
-            if (has_pgm(i)) {
-                auto range = pgm(i).search(key);
-                first = level(i).begin() + range.lo;
-                last = level(i).begin() + range.hi;
-            }
-
-            auto it = lower_bound_bl(first, last, key);
-            if (it != level(i).end() && it->first == key)
-                return it->deleted() ? end() : iterator(this, i, it);
+        uint8_t i;
+        for (i = min_level + 1; i < used_levels; ++i) {
+            auto slots_left_in_level = max_size(i) - level(i).size();
+            if (slots_required <= slots_left_in_level)
+                break;
+            slots_required += level(i).size();
+        }
+        while (i == used_levels && max_size(i) < slots_required)
+            ++i;
+        while (used_levels <= i) {
+            ++used_levels;
+            levels.emplace_back();
         }
+        if (has_pgm(i) && pgms.size() <= size_t(i - min_index_level))
+            pgms.resize(i - min_index_level + 1);
 
-        return end();
+        // The levels may have been reallocated, so the buffer is accessed again
+        Level tmp_a(slots_required + level(i).size());
+        auto tmp_end = merge<false, true>(batch.begin(), batch.end(), level(min_level).begin(),
+                                          level(min_level).end(), tmp_a.begin());
+        level(min_level).clear();
+        merge_into(i, tmp_a, std::distance(tmp_a.begin(), tmp_end));
+    }
+
+    /**
+     * Moves the merges of the levels to a background thread. From now on, when the buffer is full, it is frozen and
+     * the insertions continue on an empty buffer. The frozen buffers stay visible to the lookups until a background
+     * merge moves them into the levels, and an insertion blocks if there are @p max_frozen_runs frozen buffers.
+     *
+     * The merged levels are installed only within the calls that modify the container, thus iterators are invalidated
+     * as with synchronous merges. The container must not be accessed concurrently.
+     * @param max_frozen_runs the maximum number of frozen buffers, between 1 and 64
+     */
+    void enable_background_merges(size_t max_frozen_runs = 8) {
+        if (max_frozen_runs == 0 || max_frozen_runs > 64)
+            throw std::invalid_argument("max_frozen_runs must be between 1 and 64");
+        if (compactor)
+            wait_merges();
+        compactor = std::make_unique<Compactor>(max_frozen_runs);
+    }
+
+    /**
+     * Waits for the background merges of all the frozen buffers, if background merges are enabled.
+     */
+    void wait_merges() {
+        while (!frozen.empty())
+            install_merged_level(true);
+    }
+
+    /**
+     * Finds an element with key equivalent to @p key.
+     * @param key key value of the element to search for
+     * @return an iterator to an element with key equivalent to @p key. If no such element is found, end() is returned
+     */
+    iterator find(const K &key) const {
+        auto result = end();
+        auto h = filter_bits ? internal::hash_key(key) : 0;
+        for_each_level([&](uint8_t i, const Level &l) {
+            if (i > min_level && !may_contain(i, h))
+                return false;
+            auto it = search_level(i, l, key);
+            if (it == l.end() || it->first != key)
+                return false;
+            if (!it->deleted())
+                result = iterator(this, i, it);
+            return true;
+        });
+        return result;
     }
 
     /**
@@ -274,28 +687,20 @@ public:
         Level tmp_b;
         auto alternate = true;
 
-        for (auto i = min_level; i < used_levels; ++i) {
-            if (level(i).empty())
-                continue;
-
-            auto lo_first = level(i).begin();
-            auto lo_last = level(i).end();
-            auto hi_first = level(i).begin();
-            auto hi_last = level(i).end();
+        for_each_level([&](uint8_t i, const Level &l) {
+            auto hi_first = l.begin();
+            auto hi_last = l.end();
             if (has_pgm(i)) {
-                auto range = pgm(i).search(lo);
-                lo_first = level(i).begin() + range.lo;
-                lo_last = level(i).begin() + range.hi;
-                range = pgm(i).search(hi);
-                hi_first = level(i).begin() + range.lo;
-                hi_last = level(i).begin() + range.hi;
+                auto range = pgm(i).search(hi);
+                hi_first = l.begin() + range.lo;
+                hi_last = l.begin() + range.hi;
             }
 
-            auto it_lo = lower_bound_bl(lo_first, lo_last, lo);
+            auto it_lo = search_level(i, l, lo);
             auto it_hi = std::upper_bound(std::max(it_lo, hi_first), hi_last, hi);
             auto range_size = std::distance(it_lo, it_hi);
             if (range_size == 0)
-                continue;
+                return false;
 
             auto tmp_size = (alternate ? tmp_a : tmp_b).size();
             (alternate ? tmp_b : tmp_a).resize(tmp_size + range_size);
@@ -304,7 +709,8 @@ public:
             tmp_size = std::distance(out_it, merge<false, false>(tmp_it, tmp_it + tmp_size, it_lo, it_hi, out_it));
             (alternate ? tmp_b : tmp_a).resize(tmp_size);
             alternate = !alternate;
-        }
+            return false;
+        });
 
         std::vector<std::pair<K, V>> result;
         result.reserve((alternate ? tmp_a : tmp_b).size());
@@ -316,6 +722,16 @@ public:
         return result;
     }
 
+    /**
+     * Returns a cursor over the elements with key between @p lo and @p hi (both inclusive). Unlike @ref range, the
+     * levels are merged lazily as the cursor advances, so the elements are neither copied nor stored. The cursor is
+     * invalidated by any modification of the container.
+     * @param lo the lower bound of the range
+     * @param hi the upper bound of the range
+     * @return a cursor positioned before the first element of the range
+     */
+    RangeCursor range_cursor(const K &lo, const K &hi) const { return RangeCursor(this, lo, hi); }
+
     /**
      * Returns an iterator pointing to the first element that is not less than (i.e. greater or equal to) @p key.
      * @param key key value to compare the elements to
@@ -327,32 +743,19 @@ public:
         uint8_t lb_level;
         std::set<K> deleted;
 
-        for (auto i = min_level; i < used_levels; ++i) {
-            if (level(i).empty())
-                continue;
-
-            auto first = level(i).begin();
-            auto last = level(i).end();
-            if (has_pgm(i)) {
-                auto range = pgm(i).search(key);
-                first = level(i).begin() + range.lo;
-                last = level(i).begin() + range.hi;
-            }
-
-            for (auto it = lower_bound_bl(first, last, key);
-                 it != level(i).end() && (!lb_set || it->first < lb->first); ++it) {
+        for_each_level([&](uint8_t i, const Level &l) {
+            for (auto it = search_level(i, l, key); it != l.end() && (!lb_set || it->first < lb->first); ++it) {
                 if (it->deleted())
                     deleted.emplace(it->first);
                 else if (deleted.find(it->first) == deleted.end()) {
-                    if (it->first == key)
-                        return iterator(this, i, it);
                     lb = it;
                     lb_level = i;
                     lb_set = true;
-                    break;
+                    return it->first == key;
                 }
             }
-        }
+            return false;
+        });
 
         if (lb_set)
             return iterator(this, lb_level, lb);
@@ -399,9 +802,11 @@ public:
      * @return the size of the container in bytes
      */
     size_t size_in_bytes() const {
-        size_t bytes = levels.size() * sizeof(Level);
+        size_t bytes = (levels.size() + frozen.size()) * sizeof(Level);
         for (auto &l: levels)
             bytes += l.size() * sizeof(Item);
+        for (auto &l: frozen)
+            bytes += l.size() * sizeof(Item);
         return index_size_in_bytes() + bytes;
     }
 
@@ -413,6 +818,8 @@ public:
         size_t bytes = 0;
         for (auto &p: pgms)
             bytes += p.size_in_bytes();
+        for (auto &f: filters)
+            bytes += f.size_in_bytes();
         return bytes;
     }
 
@@ -447,19 +854,10 @@ private:
         return std::copy(first2, last2, std::copy(first1, last1, result));
     }
 
-    template<class RandomIt>
-    static RandomIt lower_bound_bl(RandomIt first, RandomIt last, const K &x) {
-        if (first == last)
-            return first;
-        auto n = std::distance(first, last);
-        while (n > 1) {
-            auto half = n / 2;
-            __builtin_prefetch(&*(first + half / 2), 0, 0);
-            __builtin_prefetch(&*(first + half + half / 2), 0, 0);
-            first = first[half] < x ? first + half : first;
-            n -= half;
-        }
-        return first + (*first < x);
+    typename Level::const_iterator search_level(uint8_t i, const Level &l, const K &key) const {
+        if (has_pgm(i))
+            return internal::search_range<Search>(l.begin(), pgm(i).search(key), key);
+        return internal::branchless_lower_bound(l.begin(), l.end(), key);
     }
 };
 
@@ -504,7 +902,12 @@ public:
 
     LoserTree() = default;
 
-    explicit LoserTree(const Source &ik) : k(next_pow2(ik)), losers(2 * k) {
+    explicit LoserTree(const Source &ik) { reset(ik); }
+
+    /** Empties the tree and makes room for @p ik sequences, reusing the memory of the nodes when possible. */
+    void reset(const Source &ik) {
+        k = next_pow2(ik);
+        losers.assign(2 * k, Loser());
         for (auto i = ik - 1u; i < k; ++i) {
             losers[i + k].key = std::numeric_limits<T>::max();
             losers[i + k].source = std::numeric_limits<Source>::max();
@@ -517,6 +920,14 @@ public:
         return losers[0].source;
     }
 
+    /** Returns the smallest key of the sequences other than min_source(), which lost to it on its path to the root. */
+    T runner_up_key() const {
+        auto key = std::numeric_limits<T>::max();
+        for (auto pos = (k + losers[0].source) / 2; pos > 0; pos /= 2)
+            key = std::min(key, losers[pos].key);
+        return key;
+    }
+
     /** Inserts the initial element of the sequence source. */
     void insert_start(const T *key_ptr, const Source &source) {
         Source pos = k + source;
@@ -547,18 +958,20 @@ public:
 
 } // namespace internal
 
-template<typename K, typename V, typename PGMType>
-class DynamicPGMIndex<K, V, PGMType>::Iterator {
+template<typename K, typename V, typename PGMType, typename Search, typename Allocator>
+class DynamicPGMIndex<K, V, PGMType, Search, Allocator>::Iterator {
     friend class DynamicPGMIndex;
 
     using level_iterator = typename Level::const_iterator;
-    using dynamic_pgm_type = DynamicPGMIndex<K, V, PGMType>;
+    using dynamic_pgm_type = DynamicPGMIndex<K, V, PGMType, Search, Allocator>;
 
     struct Cursor {
         uint8_t level_number;
         level_iterator iterator;
+        level_iterator end;
         Cursor() = default;
-        Cursor(uint8_t level_number, const level_iterator iterator) : level_number(level_number), iterator(iterator) {}
+        Cursor(uint8_t level_number, const level_iterator iterator, const level_iterator end = {})
+            : level_number(level_number), iterator(iterator), end(end) {}
     };
 
     const dynamic_pgm_type *super;  ///< Pointer to the container that is being iterated.
@@ -573,12 +986,8 @@ class DynamicPGMIndex<K, V, PGMType>::Iterator {
             return;
 
         // For each level create and position an iterator to the first key > current
-        iterators.reserve(super->used_levels - super->min_level);
-        for (uint8_t i = super->min_level; i < super->used_levels; ++i) {
-            auto &level = super->level(i);
-            if (level.empty())
-                continue;
-
+        iterators.reserve(super->used_levels - super->min_level + super->frozen.size());
+        super->for_each_level([&](uint8_t i, const Level &level) {
             size_t lo = 0;
             size_t hi = level.size();
             if (super->has_pgm(i)) {
@@ -589,8 +998,9 @@ class DynamicPGMIndex<K, V, PGMType>::Iterator {
 
             auto pos = std::upper_bound(level.begin() + lo, level.begin() + hi, current.iterator->first);
             if (pos != level.end())
-                iterators.emplace_back(i, pos);
-        }
+                iterators.emplace_back(i, pos, level.end());
+            return false;
+        });
 
         tree = decltype(tree)(iterators.size());
         for (size_t i = 0; i < iterators.size(); ++i)
@@ -612,7 +1022,7 @@ class DynamicPGMIndex<K, V, PGMType>::Iterator {
             auto level_number = it_min.level_number;
             auto result = it_min.iterator;
             ++it_min.iterator;
-            if (it_min.iterator == super->level(level_number).end()) {
+            if (it_min.iterator == it_min.end) {
                 tree.delete_min_insert(nullptr);
                 --unconsumed_count;
             } else
@@ -666,10 +1076,199 @@ public:
     bool operator!=(const Iterator &rhs) const { return !(*this == rhs); }
 };
 
+template<typename K, typename V, typename PGMType, typename Search, typename Allocator>
+class DynamicPGMIndex<K, V, PGMType, Search, Allocator>::RangeCursor {
+    friend class DynamicPGMIndex;
+
+    using level_iterator = typename Level::const_iterator;
+    using dynamic_pgm_type = DynamicPGMIndex<K, V, PGMType, Search, Allocator>;
+
+    struct Run {
+        level_iterator iterator;
+        level_iterator end;
+    };
+
+    const dynamic_pgm_type *super; ///< Pointer to the container that is being scanned.
+    K hi;                          ///< Upper bound of the range, inclusive.
+    K limit;                       ///< Smallest key of the runs other than the one that won the last comparison.
+    uint8_t unconsumed_count;      ///< Number of runs that have not yet gone past hi.
+    internal::LoserTree<K> tree;   ///< Tournament tree with one leaf for each run.
+    std::vector<Run> runs;         ///< Iterators to the next element of each level, from the newest level.
+
+    RangeCursor(const dynamic_pgm_type *p, const K &lo, const K &hi)
+        : super(p), hi(hi), limit(), unconsumed_count(), tree(), runs() { seek(lo, hi); }
+
+    /** Moves the run with the smallest key to its next element, and returns an iterator to the element it was on. */
+    level_iterator step() {
+        auto &run = runs[tree.min_source()];
+        auto result = run.iterator++;
+        if (run.iterator == run.end || run.iterator->first > hi) {
+            tree.delete_min_insert(nullptr);
+            --unconsumed_count;
+        } else
+            tree.delete_min_insert(&run.iterator->first);
+        return result;
+    }
+
+public:
+
+    using value_type = std::pair<K, V>;
+
+    /**
+     * Repositions the cursor before the first element with key between @p lo and @p hi (both inclusive). The memory
+     * of the cursor is reused, so scanning many ranges with the same cursor does not allocate.
+     * @param lo the lower bound of the range
+     * @param hi the upper bound of the range
+     */
+    void seek(const K &lo, const K &hi) {
+        if (lo > hi)
+            throw std::invalid_argument("lo > hi");
+
+        this->hi = hi;
+        runs.clear();
+        super->for_each_level([&](uint8_t i, const Level &level) {
+            auto it = super->search_level(i, level, lo);
+            if (it != level.end() && it->first <= hi)
+                runs.push_back({it, level.end()});
+            return false;
+        });
+
+        unconsumed_count = runs.size();
+        if (runs.empty())
+            return;
+        tree.reset(runs.size());
+        for (size_t i = 0; i < runs.size(); ++i)
+            tree.insert_start(&runs[i].iterator->first, i);
+        tree.init();
+        limit = tree.runner_up_key();
+    }
+
+    /**
+     * Advances the cursor to the next element of the range.
+     * @return a pointer to the element, or nullptr if the range has been exhausted
+     */
+    const Item *next() {
+        while (unconsumed_count > 0) {
+            auto &run = runs[tree.min_source()];
+            auto it = run.iterator;
+            if (it != run.end && it->first <= hi && (unconsumed_count == 1 || it->first < limit)) {
+                // The other runs are where they were when limit was computed, so they hold no key <= it->first
+                ++run.iterator;
+            } else {
+                // Bring the key of the winner in the tree up to date, then pop the smallest key and its older copies
+                if (it == run.end || it->first > hi) {
+                    tree.delete_min_insert(nullptr);
+                    --unconsumed_count;
+                } else
+                    tree.delete_min_insert(&it->first);
+                if (unconsumed_count == 0)
+                    break;
+                it = step();
+                while (unconsumed_count > 0 && runs[tree.min_source()].iterator->first == it->first)
+                    step();
+                limit = tree.runner_up_key();
+            }
+            if (!it->deleted())
+                return &*it;
+        }
+        return nullptr;
+    }
+
+    /**
+     * Copies the next elements of the range into the buffer @p out, until the buffer or the range is exhausted.
+     * @param out the buffer where to write the key-value pairs
+     * @param capacity the size of the buffer
+     * @return the number of pairs written, which is 0 iff the range has been exhausted
+     */
+    size_t next_chunk(value_type *out, size_t capacity) {
+        size_t n = 0;
+        for (const Item *item; n < capacity && (item = next()) != nullptr; ++n)
+            out[n] = {item->first, item->second};
+        return n;
+    }
+};
+
+template<typename K, typename V, typename PGMType, typename Search, typename Allocator>
+class DynamicPGMIndex<K, V, PGMType, Search, Allocator>::Compactor {
+    friend class DynamicPGMIndex;
+
+    struct Job {
+        std::vector<const Level *> runs;   ///< The frozen buffers to merge, from the most recent.
+        std::vector<const Level *> levels; ///< The levels to merge after the runs, from the most recent.
+        uint8_t target;                    ///< The level that will store the merged items.
+        uint8_t merge_limit;               ///< The last level that is merged.
+        bool last_is_oldest;               ///< true iff the deleted items can be dropped when merging the last level.
+        bool build_pgm;                    ///< true iff an index must be built on the merged items.
+        uint8_t filter_bits;               ///< Bits per key of the filter on the merged items, 0 if no filter.
+        size_t size_hint;                  ///< Upper bound on the number of merged items.
+    };
+
+    const size_t max_frozen_runs;   ///< The maximum number of frozen buffers before an insertion blocks.
+    std::mutex mutex;               ///< Protects the members below, except job while pending is true.
+    std::condition_variable job_cv; ///< Signals a new job or the stop request to the thread.
+    std::condition_variable merged_cv; ///< Signals a completed job to the container.
+    std::atomic<bool> completed;    ///< true iff the results of job are waiting to be installed.
+    bool pending;                   ///< true iff the thread is merging job.
+    bool stop;                      ///< true iff the thread must exit.
+    Job job;                        ///< The merge assigned to the thread.
+    Level merged;                   ///< The result of the last job.
+    PGMType merged_pgm;             ///< The index on merged, if job.build_pgm is true.
+    internal::BlockedBloomFilter merged_filter; ///< The filter on merged, if job.filter_bits > 0.
+    std::thread thread;             ///< The thread running the jobs, started last.
+
+    void run() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            job_cv.wait(lock, [&] { return stop || (pending && !completed); });
+            if (stop)
+                return;
+
+            lock.unlock();
+            auto result = merge_runs(job.runs, job.levels, job.last_is_oldest, job.size_hint);
+            PGMType result_pgm;
+            if (job.build_pgm)
+                result_pgm = PGMType(result.begin(), result.end());
+            internal::BlockedBloomFilter result_filter;
+            if (job.filter_bits)
+                result_filter = internal::BlockedBloomFilter(result.begin(), result.end(), job.filter_bits);
+            lock.lock();
+
+            merged = std::move(result);
+            merged_pgm = std::move(result_pgm);
+            merged_filter = std::move(result_filter);
+            completed = true;
+            pending = false;
+            merged_cv.notify_all();
+        }
+    }
+
+public:
+
+    explicit Compactor(size_t max_frozen_runs)
+        : max_frozen_runs(max_frozen_runs),
+          completed(false),
+          pending(false),
+          stop(false),
+          job(),
+          merged(),
+          merged_pgm(),
+          merged_filter(),
+          thread(&Compactor::run, this) {}
+
+    ~Compactor() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stop = true;
+        }
+        job_cv.notify_one();
+        thread.join();
+    }
+};
+
 #pragma pack(push, 1)
 
-template<typename K, typename V, typename PGMType>
-class DynamicPGMIndex<K, V, PGMType>::ItemA {
+template<typename K, typename V, typename PGMType, typename Search, typename Allocator>
+class DynamicPGMIndex<K, V, PGMType, Search, Allocator>::ItemA {
     const static V tombstone;
 
     template<typename T = V, std::enable_if_t<std::is_pointer_v<T>, int> = 0>
@@ -693,11 +1292,11 @@ public:
     bool deleted() const { return this->second == tombstone; }
 };
 
-template<typename K, typename V, typename PGMType>
-const V DynamicPGMIndex<K, V, PGMType>::ItemA::tombstone = get_tombstone<V>();
+template<typename K, typename V, typename PGMType, typename Search, typename Allocator>
+const V DynamicPGMIndex<K, V, PGMType, Search, Allocator>::ItemA::tombstone = get_tombstone<V>();
 
-template<typename K, typename V, typename PGMType>
-class DynamicPGMIndex<K, V, PGMType>::ItemB {
+template<typename K, typename V, typename PGMType, typename Search, typename Allocator>
+class DynamicPGMIndex<K, V, PGMType, Search, Allocator>::ItemB {
     bool flag;
 
 public:
@@ -18,12 +18,15 @@
 #include "morton_nd.hpp"
 #include "piecewise_linear_model.hpp"
 #include "pgm_index.hpp"
+#include "pgm_search.hpp"
 #include "sdsl.hpp"
 
 #include <fcntl.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
+#include <unistd.h>
 #include <algorithm>
+#include <array>
 #include <cerrno>
 #include <climits>
 #include <cmath>
@@ -33,9 +36,11 @@
 #include <iostream>
 #include <iterator>
 #include <limits>
+#include <memory>
 #include <numeric>
 #include <stdexcept>
 #include <string>
+#include <string_view>
 #include <tuple>
 #include <utility>
 #include <vector>
@@ -58,6 +63,312 @@ namespace pgm {
 template<typename K, size_t Epsilon, typename Floating = float>
 using OneLevelPGMIndex = PGMIndex<K, Epsilon, 0, Floating>;
 
+/**
+ * A variant of @ref PGMIndex whose number of levels is fixed at compile time.
+ *
+ * The pointers to the levels are stored in a @c std::array, and the descent through the levels is fully unrolled, so
+ * that a search does not load @c levels_offsets nor branch on the current level. The constructor throws if the data
+ * produces an index whose height, as returned by @ref PGMIndex::height(), is different from @p Height.
+ *
+ * @tparam K the type of the indexed keys
+ * @tparam Epsilon controls the size of the returned search range
+ * @tparam Height the number of levels of the index
+ * @tparam EpsilonRecursive controls the size of the search range in the internal structure
+ * @tparam Floating the floating-point type to use for slopes
+ */
+template<typename K, size_t Epsilon, size_t Height, size_t EpsilonRecursive = 4, typename Floating = float>
+class FixedHeightPGMIndex : public PGMIndex<K, Epsilon, EpsilonRecursive, Floating> {
+    static_assert(Height > 0);
+    static_assert(EpsilonRecursive > 0 || Height == 1, "An index with EpsilonRecursive = 0 has only one level");
+
+    using base = PGMIndex<K, Epsilon, EpsilonRecursive, Floating>;
+    using Segment = typename base::Segment;
+
+    std::array<const Segment *, Height> levels; ///< Pointers to the first segment of each level, from the bottom.
+    std::array<size_t, Height> levels_sizes;    ///< The number of segments in each level, from the bottom.
+
+    void init_levels() {
+        if (this->segments.empty())
+            return;
+        for (size_t l = 0; l < Height; ++l) {
+            levels[l] = this->segments.data() + this->levels_offsets[l];
+            levels_sizes[l] = this->levels_offsets[l + 1] - this->levels_offsets[l] - 1;
+        }
+    }
+
+    template<size_t L>
+    const Segment *descend(const Segment *it, const K &key) const {
+        if constexpr (L == 0)
+            return it;
+        else {
+            auto pos = std::min<size_t>((*it)(key), std::next(it)->intercept);
+            auto lo = levels[L - 1] + PGM_SUB_EPS(pos, EpsilonRecursive + 1);
+
+            if constexpr (EpsilonRecursive <= base::linear_search_threshold) {
+                return descend<L - 1>(this->scan_window(lo, key), key);
+            } else {
+                auto hi = levels[L - 1] + PGM_ADD_EPS(pos, EpsilonRecursive, levels_sizes[L - 1]);
+                return descend<L - 1>(std::prev(std::upper_bound(lo, hi, key)), key);
+            }
+        }
+    }
+
+public:
+
+    static constexpr size_t height_value = Height;
+
+    /**
+     * Constructs an empty index.
+     */
+    FixedHeightPGMIndex() = default;
+
+    /**
+     * Constructs the index on the given sorted vector.
+     * @param data the vector of keys to be indexed, must be sorted
+     */
+    explicit FixedHeightPGMIndex(const std::vector<K> &data) : FixedHeightPGMIndex(data.begin(), data.end()) {}
+
+    /**
+     * Constructs the index on the sorted keys in the range [first, last).
+     * @param first, last the range containing the sorted keys to be indexed
+     */
+    template<typename RandomIt>
+    FixedHeightPGMIndex(RandomIt first, RandomIt last) : base(first, last), levels(), levels_sizes() {
+        if (!this->segments.empty() && this->height() != Height)
+            throw std::invalid_argument("The data requires Height=" + std::to_string(this->height()));
+        init_levels();
+    }
+
+    /**
+     * Constructs the index from a @ref PGMIndex, such as one returned by @ref load_index.
+     * @param index the index whose segments are taken over
+     */
+    explicit FixedHeightPGMIndex(base index) : base(std::move(index)), levels(), levels_sizes() {
+        if (!this->segments.empty() && this->height() != Height)
+            throw std::invalid_argument("The data requires Height=" + std::to_string(this->height()));
+        init_levels();
+    }
+
+    FixedHeightPGMIndex(const FixedHeightPGMIndex &other) : base(other), levels(), levels_sizes() { init_levels(); }
+
+    FixedHeightPGMIndex(FixedHeightPGMIndex &&other) noexcept : base(std::move(other)), levels(), levels_sizes() {
+        init_levels();
+    }
+
+    FixedHeightPGMIndex &operator=(FixedHeightPGMIndex other) {
+        base::operator=(std::move(other));
+        init_levels();
+        return *this;
+    }
+
+    /**
+     * Recomputes the pointers to the levels after the segments have been moved, such as by @ref use_huge_pages.
+     */
+    void relocated() { init_levels(); }
+
+    /**
+     * Returns the approximate position and the range where @p key can be found.
+     * @param key the value of the element to search for
+     * @return a struct with the approximate position and bounds of the range
+     */
+    ApproxPos search(const K &key) const {
+        auto k = std::max(this->first_key, key);
+        const Segment *it;
+        if constexpr (EpsilonRecursive == 0)
+            it = &*std::prev(std::upper_bound(levels[0], levels[0] + levels_sizes[0], k));
+        else
+            it = descend<Height - 1>(levels[Height - 1], k);
+        auto pos = std::min<size_t>((*it)(k), std::next(it)->intercept);
+        auto lo = PGM_SUB_EPS(pos, Epsilon);
+        auto hi = PGM_ADD_EPS(pos, Epsilon, this->n);
+        return {pos, lo, hi};
+    }
+};
+
+/**
+ * A variant of @ref PGMIndex that records the actual error of each segment and returns tighter search ranges.
+ *
+ * At construction, each segment of the last level is evaluated on the keys that can be routed to it, that is, the
+ * indexed keys and the keys just past them, and the largest errors below and above the true position are stored in a
+ * small array parallel to the segments. A search returns a range [pos - below, pos + above] built from the errors of
+ * the segment, which is never larger than the range of @ref PGMIndex and is usually much smaller, at the cost of
+ * 2*sizeof(bound_type) bytes per segment. As with @ref PGMIndex, the range is guaranteed to contain the position of
+ * the first key not less than the sought key, where @c hi itself is a valid answer when all the keys in [lo, hi) are
+ * smaller.
+ *
+ * @tparam K the type of the indexed keys
+ * @tparam Epsilon controls the size of the returned search range
+ * @tparam EpsilonRecursive controls the size of the search range in the internal structure
+ * @tparam Floating the floating-point type to use for slopes
+ */
+template<typename K, size_t Epsilon = 64, size_t EpsilonRecursive = 4, typename Floating = float>
+class TightPGMIndex : public PGMIndex<K, Epsilon, EpsilonRecursive, Floating> {
+    using base = PGMIndex<K, Epsilon, EpsilonRecursive, Floating>;
+    using bound_type = std::conditional_t<Epsilon + 2 <= UINT8_MAX, uint8_t,
+                                          std::conditional_t<Epsilon + 2 <= UINT16_MAX, uint16_t, uint32_t>>;
+
+    struct Bounds {
+        bound_type below; ///< The largest distance of a prediction of the segment above the true position.
+        bound_type above; ///< The largest distance of a prediction of the segment below the true position.
+    };
+
+    std::vector<Bounds> bounds; ///< The errors of the segments in the last level.
+    double average_width = 0;   ///< The average size of the ranges returned by search on the indexed keys.
+
+    static K successor(const K &x) {
+        if constexpr (std::is_floating_point_v<K>)
+            return std::nextafter(x, std::numeric_limits<K>::infinity());
+        else
+            return x == std::numeric_limits<K>::max() ? x : K(x + 1);
+    }
+
+    static K predecessor(const K &x) {
+        if constexpr (std::is_floating_point_v<K>)
+            return std::nextafter(x, -std::numeric_limits<K>::infinity());
+        else
+            return x == std::numeric_limits<K>::lowest() ? x : K(x - 1);
+    }
+
+    /**
+     * Computes the errors of the segments in a single pass over the data. The queries increase monotonically, so
+     * their lower bounds are found by galloping forward from the previous one and the pass takes O(n) time. The keys of
+     * each segment are then searched again with its errors to compute @ref average_width.
+     */
+    template<typename RandomIt>
+    void compute_bounds(RandomIt first, RandomIt last) {
+        auto count = this->segments_count();
+        bounds.resize(count);
+        auto answer = first; // The lower bound of the current query, which increases monotonically
+        auto data = first;   // The next indexed key to use as a query
+        size_t width = 0;
+
+        for (size_t s = 0; s < count; ++s) {
+            auto segment = this->segments.begin() + s;
+            auto begin_key = K(segment->key);
+            auto end_key = K(std::next(segment)->key);
+            int64_t below = 0;
+            int64_t above = 0;
+            auto evaluate = [&](const K &q) {
+                answer = ExponentialSearch::lower_bound(answer, last, answer, q);
+                auto pos = std::min<size_t>((*segment)(q), std::next(segment)->intercept);
+                auto error = int64_t(pos) - int64_t(std::distance(first, answer));
+                below = std::max(below, error);
+                above = std::max(above, -error);
+            };
+
+            // The error of the segment is a step function that peaks at the keys of the data and right after them
+            evaluate(begin_key);
+            while (data != last && *data < begin_key)
+                ++data;
+            auto segment_data = data;
+            while (data != last && *data < end_key) {
+                K x = *data;
+                evaluate(x);
+                if (auto next = successor(x); next != x && next < end_key)
+                    evaluate(next);
+                while (data != last && !(x < *data))
+                    ++data;
+            }
+            if (auto prev = predecessor(end_key); prev > begin_key)
+                evaluate(prev);
+
+            bounds[s].below = bound_type(std::min<int64_t>(below, Epsilon));
+            bounds[s].above = bound_type(std::min<int64_t>(above, Epsilon + 2));
+            for (auto it = segment_data; it != data; ++it) {
+                auto pos = std::min<size_t>((*segment)(*it), std::next(segment)->intercept);
+                width += std::min<size_t>(pos + bounds[s].above, this->n) - PGM_SUB_EPS(pos, bounds[s].below);
+            }
+        }
+
+        auto searched = std::distance(first, data);
+        average_width = searched ? double(width) / searched : 0;
+    }
+
+public:
+
+    /**
+     * Constructs an empty index.
+     */
+    TightPGMIndex() = default;
+
+    /**
+     * Constructs the index on the given sorted vector.
+     * @param data the vector of keys to be indexed, must be sorted
+     */
+    explicit TightPGMIndex(const std::vector<K> &data) : TightPGMIndex(data.begin(), data.end()) {}
+
+    /**
+     * Constructs the index on the sorted keys in the range [first, last).
+     * @param first, last the range containing the sorted keys to be indexed
+     */
+    template<typename RandomIt>
+    TightPGMIndex(RandomIt first, RandomIt last) : base(first, last), bounds() {
+        compute_bounds(first, last);
+    }
+
+    /**
+     * Returns the approximate position and the range where @p key can be found.
+     * @param key the value of the element to search for
+     * @return a struct with the approximate position and bounds of the range
+     */
+    ApproxPos search(const K &key) const {
+        auto k = std::max(this->first_key, key);
+        auto it = this->segment_for_key(k);
+        auto pos = std::min<size_t>((*it)(k), std::next(it)->intercept);
+        auto b = bounds[std::distance(this->segments.begin(), it)];
+        auto lo = PGM_SUB_EPS(pos, b.below);
+        auto hi = std::min<size_t>(pos + b.above, this->n);
+        return {pos, lo, hi};
+    }
+
+    /**
+     * Returns the approximate positions and the ranges where each key in a batch can be found, as returned by
+     * @ref search.
+     * @param keys pointer to the values of the elements to search for
+     * @param count the number of keys in the batch
+     * @param out pointer to an array of size at least @p count where the results are written
+     */
+    void search_batch(const K *keys, size_t count, ApproxPos *out) const {
+        for (size_t i = 0; i < count; ++i)
+            out[i] = search(keys[i]);
+    }
+
+    /**
+     * Returns the approximate positions and the ranges where each key in a sorted batch can be found, as returned by
+     * @ref search.
+     * @see PGMIndex::search_sorted_batch
+     * @param keys pointer to the values of the elements to search for, sorted in non-decreasing order
+     * @param count the number of keys in the batch
+     * @param out pointer to an array of size at least @p count where the results are written
+     */
+    void search_sorted_batch(const K *keys, size_t count, ApproxPos *out) const {
+        if (count == 0)
+            return;
+
+        auto it = this->segment_for_key(std::max(this->first_key, keys[0]));
+        for (size_t i = 0; i < count; ++i) {
+            auto k = std::max(this->first_key, keys[i]);
+            it = this->segment_for_key_from(it, k);
+            auto pos = std::min<size_t>((*it)(k), std::next(it)->intercept);
+            auto b = bounds[std::distance(this->segments.begin(), it)];
+            out[i] = {pos, PGM_SUB_EPS(pos, b.below), std::min<size_t>(pos + b.above, this->n)};
+        }
+    }
+
+    /**
+     * Returns the average size of the ranges returned by @ref search on the indexed keys, that is, the average of
+     * hi - lo weighted by the number of keys that each segment indexes.
+     * @return the average size of the search ranges
+     */
+    double average_window_width() const { return average_width; }
+
+    /**
+     * Returns the size of the index in bytes, including the errors of the segments.
+     * @return the size of the index in bytes
+     */
+    size_t size_in_bytes() const { return base::size_in_bytes() + bounds.size() * sizeof(Bounds); }
+};
+
 /**
  * A variant of @ref PGMIndex that uses compression on the segments to reduce the space of the index.
  *
@@ -110,16 +421,11 @@ public:
         std::vector<canonical_segment> segments;
         segments.reserve(n / (Epsilon * Epsilon));
 
-        auto ignore_last = *std::prev(last) == std::numeric_limits<K>::max(); // max is reserved for padding
-        auto last_n = n - ignore_last;
-        last -= ignore_last;
+        auto last_n = internal::first_level_size(first, last);
+        last = first + last_n;
 
         // Build first level
-        auto in_fun = [&](auto i) {
-            auto x = first[i];
-            auto flag = i > 0 && i + 1u < n && x == first[i - 1] && x != first[i + 1] && x + 1 != first[i + 1];
-            return std::pair<K, size_t>(x + flag, i);
-        };
+        auto in_fun = [&](auto i) { return std::pair<K, size_t>(internal::first_level_key(first, n, i), i); };
         auto out_fun = [&](auto cs) { segments.emplace_back(cs); };
         last_n = internal::make_segmentation_par(last_n, Epsilon, in_fun, out_fun);
         levels_offsets.push_back(levels_offsets.back() + last_n);
@@ -194,11 +500,16 @@ public:
 
             static constexpr size_t linear_search_threshold = 8 * 64 / sizeof(K);
             if constexpr (EpsilonRecursive <= linear_search_threshold) {
-                for (; *std::next(lo) <= key; ++lo)
+                constexpr size_t window = 2 * EpsilonRecursive + 2;
+                if constexpr (window < 64) {
+                    if (size_t(std::distance(lo, level.keys.end())) > window)
+                        lo += internal::leading_not_greater<window, sizeof(K)>(&*std::next(lo), k);
+                }
+                for (; *std::next(lo) <= k; ++lo)
                     continue;
             } else {
                 auto hi = level.keys.begin() + PGM_ADD_EPS(pos, EpsilonRecursive, level.size());
-                auto it = std::prev(std::upper_bound(lo, hi, k));
+                lo = std::prev(std::upper_bound(lo, hi, k));
             }
 
             auto i = std::distance(level.keys.begin(), lo);
@@ -641,6 +952,250 @@ private:
     }
 };
 
+namespace internal {
+
+/** The version of the file format written by @ref save_index and @ref MappedPGMIndex. */
+constexpr uint32_t index_file_version = 1;
+
+/** The alignment in bytes of the sections of an index file, a multiple of the page size of common platforms. */
+constexpr size_t index_file_alignment = 4096;
+
+/**
+ * The header at the beginning of an index file.
+ *
+ * The header is followed by up to four sections, each starting at an offset that is a multiple of
+ * @ref index_file_alignment: the levels offsets, the segments (or their keys with @ref SplitLayout), the linear models
+ * of the segments (only with @ref SplitLayout), and the indexed keys (only for @ref MappedPGMIndex). The sections store
+ * the arrays of the index as they are laid out in memory, so that a mapping of the file can be used in place.
+ */
+struct IndexFileHeader {
+    enum Section : size_t { levels_offsets_section, segments_section, models_section, data_section, sections_count };
+
+    char magic[8];                    ///< The bytes "PGMINDEX".
+    uint32_t version;                 ///< The version of the file format.
+    uint32_t byte_order;              ///< The value 0x01020304 written with the endianness of the writer.
+    uint32_t layout;                  ///< 0 for @ref InterleavedLayout, 1 for @ref SplitLayout.
+    uint32_t key_kind;                ///< 0 for unsigned integers, 1 for signed integers, 2 for floating-point keys.
+    uint32_t key_bytes;               ///< The size in bytes of a key.
+    uint32_t floating_bytes;          ///< The size in bytes of a slope.
+    uint32_t segment_bytes;           ///< The size in bytes of an element of the segments section.
+    uint32_t slope_kind;              ///< 0 for floating-point slopes, 1 for @ref FixedPointSlope.
+    uint64_t epsilon;                 ///< The Epsilon parameter of the index.
+    uint64_t epsilon_recursive;       ///< The EpsilonRecursive parameter of the index.
+    uint64_t n;                       ///< The number of elements the index was built on.
+    unsigned char first_key[16];      ///< The bytes of the smallest element.
+    uint64_t offsets[sections_count]; ///< The offset in bytes of each section from the beginning of the file.
+    uint64_t sizes[sections_count];   ///< The number of elements in each section.
+};
+
+template<typename K, size_t Epsilon, size_t EpsilonRecursive, typename Floating, typename Layout>
+PGMIndex<K, Epsilon, EpsilonRecursive, Floating, Layout> index_base(const PGMIndex<K, Epsilon, EpsilonRecursive,
+                                                                                   Floating, Layout> *);
+
+/** The @ref PGMIndex class that @p Index is derived from. */
+template<typename Index>
+using index_base_t = decltype(index_base(std::declval<Index *>()));
+
+template<typename K, size_t Epsilon, size_t EpsilonRecursive, typename Floating, typename Layout>
+IndexFileHeader make_index_file_header(const PGMIndex<K, Epsilon, EpsilonRecursive, Floating, Layout> &index) {
+    static_assert(sizeof(K) <= sizeof(IndexFileHeader::first_key));
+    constexpr auto split = std::is_same_v<Layout, SplitLayout>;
+    IndexFileHeader header{};
+    std::memcpy(header.magic, "PGMINDEX", sizeof(header.magic));
+    header.version = index_file_version;
+    header.byte_order = 0x01020304;
+    header.layout = split;
+    header.key_kind = std::is_floating_point_v<K> ? 2 : std::is_signed_v<K>;
+    header.key_bytes = sizeof(K);
+    header.floating_bytes = sizeof(Floating);
+    header.slope_kind = is_fixed_point_slope_v<Floating>;
+    if constexpr (split)
+        header.segment_bytes = sizeof(K);
+    else
+        header.segment_bytes = sizeof(typename PGMIndex<K, Epsilon, EpsilonRecursive, Floating, Layout>::Segment);
+    header.epsilon = Epsilon;
+    header.epsilon_recursive = EpsilonRecursive;
+    header.n = index.n;
+    std::memcpy(header.first_key, &index.first_key, sizeof(K));
+    return header;
+}
+
+/**
+ * Writes @p index and, if not empty, the keys in the range [first, last) to the file @p filename.
+ * @return the size in bytes of the file
+ */
+template<typename K, size_t Epsilon, size_t EpsilonRecursive, typename Floating, typename Layout, typename RandomIt>
+size_t write_index_file(const PGMIndex<K, Epsilon, EpsilonRecursive, Floating, Layout> &index,
+                        RandomIt first, RandomIt last, const std::string &filename) {
+    auto out = std::ofstream(filename, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!out)
+        throw std::runtime_error("Open file error " + filename);
+
+    auto header = make_index_file_header(index);
+    out.write((char *) &header, sizeof(header));
+    size_t bytes = sizeof(header);
+    auto begin_section = [&](IndexFileHeader::Section section, size_t size) {
+        char padding[index_file_alignment] = {};
+        auto padding_bytes = (index_file_alignment - bytes % index_file_alignment) % index_file_alignment;
+        out.write(padding, padding_bytes);
+        bytes += padding_bytes;
+        header.offsets[section] = bytes;
+        header.sizes[section] = size;
+    };
+    auto write_array = [&](IndexFileHeader::Section section, const auto &array) {
+        begin_section(section, array.size());
+        out.write((const char *) array.data(), array.size() * sizeof(array[0]));
+        bytes += array.size() * sizeof(array[0]);
+    };
+
+    write_array(IndexFileHeader::levels_offsets_section, index.levels_offsets);
+    if constexpr (std::is_same_v<Layout, SplitLayout>) {
+        write_array(IndexFileHeader::segments_section, index.keys);
+        write_array(IndexFileHeader::models_section, index.models);
+    } else
+        write_array(IndexFileHeader::segments_section, index.segments);
+
+    begin_section(IndexFileHeader::data_section, std::distance(first, last));
+    for (auto it = first; it != last; ++it) {
+        K x = *it;
+        out.write((char *) &x, sizeof(K));
+    }
+    bytes += std::distance(first, last) * sizeof(K);
+
+    out.seekp(0);
+    out.write((char *) &header, sizeof(header));
+    if (!out.flush())
+        throw std::runtime_error("Write error " + filename);
+    return bytes;
+}
+
+/**
+ * Maps the whole file @p filename read-only in memory.
+ * @return a pointer to the first byte of the mapping, which is released when the last copy of the pointer is destroyed
+ */
+inline std::shared_ptr<const char> map_file(const std::string &filename, size_t &file_bytes) {
+    auto fd = open(filename.c_str(), O_RDONLY);
+    if (fd == -1)
+        throw std::runtime_error("Open file error " + std::string(strerror(errno)));
+
+    struct stat fs;
+    if (fstat(fd, &fs) == -1) {
+        close(fd);
+        throw std::runtime_error("stat error " + std::string(strerror(errno)));
+    }
+    file_bytes = fs.st_size;
+    if (file_bytes == 0) {
+        close(fd);
+        return {};
+    }
+
+    auto data = mmap(nullptr, file_bytes, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        throw std::runtime_error("mmap error " + std::string(strerror(errno)));
+
+    return std::shared_ptr<const char>((const char *) data, [file_bytes](const char *p) {
+        if (munmap((void *) p, file_bytes))
+            std::cerr << "munmap error " << std::string(strerror(errno));
+    });
+}
+
+/**
+ * Maps the index file @p filename in memory and makes the arrays of @p index refer to the mapped sections.
+ * @return the header of the file
+ */
+template<typename K, size_t Epsilon, size_t EpsilonRecursive, typename Floating, typename Layout>
+IndexFileHeader read_index_file(const std::string &filename,
+                                PGMIndex<K, Epsilon, EpsilonRecursive, Floating, Layout> &index,
+                                std::shared_ptr<const char> &file) {
+    size_t file_bytes;
+    file = map_file(filename, file_bytes);
+    IndexFileHeader header;
+    if (file_bytes < sizeof(header))
+        throw std::runtime_error("Invalid index file " + filename);
+    std::memcpy(&header, file.get(), sizeof(header));
+
+    auto expected = make_index_file_header(index);
+    if (std::memcmp(header.magic, expected.magic, sizeof(header.magic)) != 0
+        || header.byte_order != expected.byte_order)
+        throw std::runtime_error("Invalid index file " + filename);
+    if (header.version != index_file_version)
+        throw std::runtime_error("Unsupported index file version " + std::to_string(header.version));
+    if (header.layout != expected.layout || header.key_kind != expected.key_kind
+        || header.key_bytes != expected.key_bytes || header.floating_bytes != expected.floating_bytes
+        || header.slope_kind != expected.slope_kind || header.segment_bytes != expected.segment_bytes
+        || header.epsilon != expected.epsilon || header.epsilon_recursive != expected.epsilon_recursive)
+        throw std::invalid_argument("The index file " + filename + " was written by a different index type");
+
+    size_t element_bytes[] = {sizeof(size_t), header.segment_bytes, 0, sizeof(K)};
+    if constexpr (std::is_same_v<Layout, SplitLayout>)
+        element_bytes[IndexFileHeader::models_section] = sizeof(typename decltype(index.models)::value_type);
+    for (size_t s = 0; s < IndexFileHeader::sections_count; ++s) {
+        auto offset = header.offsets[s];
+        if (offset % index_file_alignment != 0 || offset > file_bytes
+            || (element_bytes[s] != 0 && header.sizes[s] > (file_bytes - offset) / element_bytes[s]))
+            throw std::runtime_error("Invalid index file " + filename);
+    }
+
+    auto section = [&](auto &array, IndexFileHeader::Section s) {
+        using value_type = typename std::remove_reference_t<decltype(array)>::value_type;
+        array = {(const value_type *) (file.get() + header.offsets[s]), header.sizes[s], file};
+    };
+    index.n = header.n;
+    std::memcpy(&index.first_key, header.first_key, sizeof(K));
+    section(index.levels_offsets, IndexFileHeader::levels_offsets_section);
+    if constexpr (std::is_same_v<Layout, SplitLayout>) {
+        section(index.keys, IndexFileHeader::segments_section);
+        section(index.models, IndexFileHeader::models_section);
+    } else
+        section(index.segments, IndexFileHeader::segments_section);
+    return header;
+}
+
+} // namespace internal
+
+/**
+ * Writes an index to a file, in a versioned format whose sections are aligned to the page size.
+ *
+ * The file can be loaded with @ref load_index, which maps it in memory and uses the segments in place. The index can be
+ * a @ref PGMIndex with any layout, or one of its variants that derive from it, such as @ref FixedHeightPGMIndex, except
+ * for @ref TightPGMIndex. A @ref StringPGMIndex cannot be saved either, since the file format has no sections for its
+ * strings and their offsets.
+ * @param index the index to write
+ * @param filename the name of the output file
+ */
+template<typename K, size_t Epsilon, size_t EpsilonRecursive, typename Floating, typename Layout>
+void save_index(const PGMIndex<K, Epsilon, EpsilonRecursive, Floating, Layout> &index, const std::string &filename) {
+    internal::write_index_file(index, (const K *) nullptr, (const K *) nullptr, filename);
+}
+
+/**
+ * A @ref TightPGMIndex cannot be saved, since the file format has no section for its error bounds, which would be lost.
+ */
+template<typename K, size_t Epsilon, size_t EpsilonRecursive, typename Floating>
+void save_index(const TightPGMIndex<K, Epsilon, EpsilonRecursive, Floating> &, const std::string &) = delete;
+
+/**
+ * Loads an index from a file written by @ref save_index.
+ *
+ * The file is mapped read-only in memory, and the segments of the returned index refer to the mapping, which is kept
+ * until the index and its copies are destroyed. Hence, loading takes constant time regardless of the size of the index,
+ * and processes mapping the same file share its pages.
+ * @tparam Index the type of the index, which must match the type of the index written to the file
+ * @param filename the name of the input file
+ * @return the index stored in the file
+ */
+template<typename Index>
+Index load_index(const std::string &filename) {
+    internal::index_base_t<Index> index;
+    std::shared_ptr<const char> file;
+    internal::read_index_file(filename, index, file);
+    if constexpr (std::is_same_v<Index, decltype(index)>)
+        return index;
+    else
+        return Index(std::move(index));
+}
+
 /**
  * A disk-backed container storing a sorted sequence of numbers and a @ref PGMIndex for fast search operations.
  *
@@ -648,13 +1203,15 @@ private:
  * @tparam Epsilon controls the size of the returned search range
  * @tparam EpsilonRecursive controls the size of the search range in the internal structure
  * @tparam Floating the floating-point type to use for slopes
+ * @tparam Search the last-mile search policy used on the window returned by the index, such as @ref ExponentialSearch
  */
-template<typename K, size_t Epsilon, size_t EpsilonRecursive = 4, typename Floating = float>
+template<typename K, size_t Epsilon, size_t EpsilonRecursive = 4, typename Floating = float,
+    typename Search = AdaptiveSearch>
 class MappedPGMIndex : public PGMIndex<K, Epsilon, EpsilonRecursive, Floating> {
     using base = PGMIndex<K, Epsilon, EpsilonRecursive, Floating>;
-    K *data;
+    std::shared_ptr<const char> file;
+    const K *data;
     size_t file_bytes;
-    size_t header_bytes;
 
 public:
 
@@ -666,9 +1223,9 @@ public:
     template<class RandomIt>
     MappedPGMIndex(RandomIt first, RandomIt last, const std::string &out_filename)
         : base(first, last),
+          file(),
           data(),
-          file_bytes(),
-          header_bytes() {
+          file_bytes() {
         serialize_and_map(first, last, out_filename);
     }
 
@@ -683,55 +1240,44 @@ public:
      */
     MappedPGMIndex(const std::string &in_filename, const std::string &out_filename)
         : base(),
+          file(),
           data(),
-          file_bytes(),
-          header_bytes() {
-        struct stat fs;
-        stat(in_filename.c_str(), &fs);
-        auto in_bytes = fs.st_size;
+          file_bytes() {
+        size_t in_bytes;
+        auto in_file = internal::map_file(in_filename, in_bytes);
         if (in_bytes % sizeof(K) != 0)
             throw std::runtime_error("Input file size must be a multiple of " + std::to_string(sizeof(K)) + " bytes.");
 
-        auto in_data = map_file(in_filename, in_bytes);
+        auto in_data = (const K *) in_file.get();
         this->n = in_bytes / sizeof(K);
+        this->first_key = this->n ? in_data[0] : K(0);
         this->template build(in_data, in_data + this->n, Epsilon, EpsilonRecursive,
                              this->segments, this->levels_offsets);
         serialize_and_map(in_data, in_data + this->n, out_filename);
-        unmap_file(in_data, in_bytes);
     }
 
     /**
      * Loads a disk-backed container from the given file.
+     *
+     * The whole file is mapped read-only in memory, and both the keys and the segments are used in place.
      * @param in_filename the name of the input file
      */
     explicit MappedPGMIndex(const std::string &in_filename)
         : base(),
+          file(),
           data(),
-          file_bytes(),
-          header_bytes() {
-        auto in = std::fstream(in_filename, std::ios::in | std::ios::binary);
-        read_member(header_bytes, in);
-        read_member(this->n, in);
-        read_member(this->first_key, in);
-        read_container(this->levels_offsets, in);
-        read_container(this->segments, in);
-        file_bytes = header_bytes + this->n * sizeof(K);
-        data = map_file(in_filename, file_bytes);
+          file_bytes() {
+        map(in_filename);
     }
 
-    /**
-     * Destructs the object and closes the file backing the container.
-     */
-    ~MappedPGMIndex() { unmap_file(data, file_bytes); }
-
     /**
      * Checks if there is an element with key equivalent to @p key in the container.
      * @param key the value of the element to search for
      * @return @c true if there is such an element, otherwise @c false
      */
     bool contains(const K &key) const {
-        auto range = this->search(key);
-        return std::binary_search(begin() + range.lo, begin() + range.hi, key);
+        auto it = lower_bound(key);
+        return it != end() && *it == key;
     }
 
     /**
@@ -740,8 +1286,7 @@ public:
      * @return iterator to the first element that is not less than @p key, or @ref end() if no such element is found
      */
     auto lower_bound(const K &key) const {
-        auto range = this->search(key);
-        return std::lower_bound(begin() + range.lo, begin() + range.hi, key);
+        return internal::search_range<Search>(begin(), this->search(key), key);
     }
 
     /**
@@ -786,7 +1331,7 @@ public:
      * Returns an iterator to the first element of the container.
      * @return an iterator to the first element of the container
      */
-    auto begin() const { return (K *) ((char *) data + header_bytes); }
+    auto begin() const { return data; }
 
     /**
      * Returns an iterator to the element following the last element of the container.
@@ -798,69 +1343,198 @@ private:
 
     template<class RandomIt>
     void serialize_and_map(RandomIt first, RandomIt last, const std::string &out_filename) {
-        auto out = std::fstream(out_filename, std::ios::out | std::ios::binary);
-        header_bytes += write_member(header_bytes, out);
-        header_bytes += write_member(this->n, out);
-        header_bytes += write_member(this->first_key, out);
-        header_bytes += write_container(this->levels_offsets, out);
-        header_bytes += write_container(this->segments, out);
-        for (auto it = first; it != last; ++it)
-            write_member(*it, out);
-        file_bytes = header_bytes + this->n * sizeof(K);
-        out.seekp(0);
-        write_member(header_bytes, out);
-        data = map_file(out_filename, file_bytes);
+        internal::write_index_file(*this, first, last, out_filename);
+        map(out_filename);
+    }
+
+    void map(const std::string &in_filename) {
+        auto header = internal::read_index_file(in_filename, static_cast<base &>(*this), file);
+        if (header.sizes[internal::IndexFileHeader::data_section] != this->n)
+            throw std::runtime_error("Invalid index file " + in_filename);
+        data = (const K *) (file.get() + header.offsets[internal::IndexFileHeader::data_section]);
+        file_bytes = header.offsets[internal::IndexFileHeader::data_section] + this->n * sizeof(K);
+    }
+};
+
+/**
+ * A container storing a sorted sequence of strings and a @ref PGMIndex for fast search operations.
+ *
+ * The index learns the mapping from a packed prefix of each string: an unsigned 128-bit integer holding the first 15
+ * bytes in big-endian order followed by the length of the string capped at 16, so that the order of the packed
+ * prefixes agrees with the lexicographic order of the strings, and equal packed prefixes of strings shorter than 16
+ * bytes imply equal strings. The full strings are stored back to back in a contiguous arena, which is accessed only
+ * for runs of longer strings sharing the same packed prefix. These runs are resolved with an exponential search that
+ * compares the full strings.
+ *
+ * @tparam Epsilon controls the size of the returned search range
+ * @tparam EpsilonRecursive controls the size of the search range in the internal structure
+ * @tparam Floating the floating-point type to use for slopes
+ */
+template<size_t Epsilon = 64, size_t EpsilonRecursive = 4, typename Floating = float>
+class StringPGMIndex {
+public:
+    using prefix_type = unsigned __int128;
+
+private:
+    std::vector<char> arena;             ///< The characters of the strings, concatenated.
+    std::vector<size_t> offsets;         ///< The starting position of each string in arena[], plus the arena size.
+    std::vector<prefix_type> prefixes;   ///< The packed prefix of each string.
+    PGMIndex<prefix_type, Epsilon, EpsilonRecursive, Floating> index; ///< The index on the packed prefixes.
+
+    template<bool Upper>
+    size_t bound(std::string_view key) const {
+        if (prefixes.empty())
+            return 0;
+
+        // Windows of up to 1 KB are scanned linearly, as their cache lines can be fetched in parallel
+        auto p = pack_prefix(key);
+        auto range = index.search(p);
+        auto window_size = range.hi - range.lo;
+        size_t pos = range.lo;
+        if (window_size * sizeof(prefix_type) <= 2 * internal::linear_scan_threshold)
+            pos += internal::count_less(prefixes.data() + range.lo, window_size, p);
+        else
+            pos = std::distance(prefixes.begin(), std::lower_bound(prefixes.begin() + pos, prefixes.begin() + range.hi, p));
+
+        auto before = [&](size_t i) {
+            if (prefixes[i] != p)
+                return prefixes[i] < p;
+            if (uint8_t(p) < 16)
+                return Upper;
+            return Upper ? (*this)[i] <= key : (*this)[i] < key;
+        };
+        if (pos == size() || !before(pos))
+            return pos;
+
+        // Exponential search through the run of strings sharing the packed prefix of key
+        size_t step = 1;
+        while (pos + step < size() && prefixes[pos + step] == p && before(pos + step))
+            step *= 2;
+        auto first = pos + step / 2 + 1;
+        auto count = std::min(pos + step, size()) - first;
+        while (count > 0) {
+            auto half = count / 2;
+            if (before(first + half)) {
+                first += half + 1;
+                count -= half + 1;
+            } else
+                count = half;
+        }
+        return first;
     }
 
-    static K *map_file(const std::string &in_filename, size_t file_bytes) {
-        auto fd = open(in_filename.c_str(), O_RDONLY);
-        if (fd == -1)
-            throw std::runtime_error("Open file error" + std::string(strerror(errno)));
+public:
 
-        auto data = (K *) mmap(nullptr, file_bytes, PROT_READ, MAP_SHARED, fd, 0);
-        if (data == MAP_FAILED)
-            throw std::runtime_error("mmap error" + std::string(strerror(errno)));
-        return data;
+    /**
+     * Packs the first 15 bytes of a string, padded with zeros, and its length capped at 16 into an unsigned 128-bit
+     * integer.
+     * @param s the string to pack
+     * @return the packed prefix of @p s
+     */
+    static prefix_type pack_prefix(std::string_view s) {
+        unsigned char buffer[16] = {};
+        std::memcpy(buffer, s.data(), std::min<size_t>(s.size(), sizeof(buffer) - 1));
+        buffer[sizeof(buffer) - 1] = std::min<size_t>(s.size(), sizeof(buffer));
+        uint64_t high, low;
+        std::memcpy(&high, buffer, sizeof(high));
+        std::memcpy(&low, buffer + sizeof(high), sizeof(low));
+        return (prefix_type) __builtin_bswap64(high) << 64 | __builtin_bswap64(low);
     }
 
-    static void unmap_file(K *data, size_t file_bytes) {
-        if (data && munmap(data, file_bytes))
-            std::cerr << "munmap error " << std::string(strerror(errno));
+    /**
+     * Constructs an empty container.
+     */
+    StringPGMIndex() : arena(), offsets(1, 0), prefixes(), index() {}
+
+    /**
+     * Constructs the container on the sorted strings in the range [first, last).
+     * @param first, last the range containing the sorted strings to copy
+     */
+    template<typename RandomIt>
+    StringPGMIndex(RandomIt first, RandomIt last) : arena(), offsets(), prefixes(), index() {
+        auto n = (size_t) std::distance(first, last);
+        size_t total_bytes = 0;
+        for (auto it = first; it != last; ++it)
+            total_bytes += std::string_view(*it).size();
+
+        arena.reserve(total_bytes);
+        offsets.reserve(n + 1);
+        prefixes.reserve(n);
+        offsets.push_back(0);
+        for (auto it = first; it != last; ++it) {
+            std::string_view s(*it);
+            arena.insert(arena.end(), s.begin(), s.end());
+            offsets.push_back(arena.size());
+            prefixes.push_back(pack_prefix(s));
+        }
+
+        index = decltype(index)(prefixes.begin(), prefixes.end());
     }
 
-    template<typename T>
-    static size_t write_member(const T &x, std::ostream &out) {
-        out.write((char *) &x, sizeof(T));
-        return sizeof(T);
+    /**
+     * Returns the string at the specified position.
+     * @param i the position of the string
+     * @return a view of the string at position @p i
+     */
+    std::string_view operator[](size_t i) const {
+        return std::string_view(arena.data() + offsets[i], offsets[i + 1] - offsets[i]);
     }
 
-    template<typename T>
-    static void read_member(T &x, std::istream &in) {
-        in.read((char *) &x, sizeof(T));
+    /**
+     * Checks if there is a string equal to @p key in the container.
+     * @param key the value of the string to search for
+     * @return @c true if there is such a string, otherwise @c false
+     */
+    bool contains(std::string_view key) const {
+        auto pos = lower_bound(key);
+        return pos != size() && (*this)[pos] == key;
     }
 
-    template<typename C>
-    static size_t write_container(const C &container, std::ostream &out) {
-        using value_type = typename C::value_type;
-        size_t written_bytes = write_member(container.size(), out);
-        for (auto &x: container) {
-            out.write((char *) &x, sizeof(value_type));
-            written_bytes += sizeof(value_type);
-        }
-        return written_bytes;
-    }
-
-    template<typename C>
-    static void read_container(C &container, std::istream &in) {
-        using value_type = typename C::value_type;
-        typename C::size_type size;
-        read_member(size, in);
-        container.reserve(size);
-        for (size_t i = 0; i < size; ++i) {
-            value_type s;
-            in.read((char *) &s, sizeof(value_type));
-            container.push_back(s);
-        }
+    /**
+     * Returns the position of the first string that is not less than (i.e. greater or equal to) @p key.
+     * @param key value to compare the strings to
+     * @return the position of the first string not less than @p key, or @ref size() if no such string is found
+     */
+    size_t lower_bound(std::string_view key) const { return bound<false>(key); }
+
+    /**
+     * Returns the position of the first string that is greater than @p key.
+     * @param key value to compare the strings to
+     * @return the position of the first string greater than @p key, or @ref size() if no such string is found
+     */
+    size_t upper_bound(std::string_view key) const { return bound<true>(key); }
+
+    /**
+     * Returns the number of strings equal to the specified argument.
+     * @param key value of the strings to count
+     * @return the number of strings equal to @p key
+     */
+    size_t count(std::string_view key) const {
+        auto lb = lower_bound(key);
+        if (lb == size() || (*this)[lb] != key)
+            return 0;
+        return upper_bound(key) - lb;
+    }
+
+    /**
+     * Returns the number of strings in the container.
+     * @return the number of strings in the container
+     */
+    size_t size() const { return prefixes.size(); }
+
+    /**
+     * Returns the size of the index on the packed prefixes in bytes.
+     * @return the size of the index in bytes
+     */
+    size_t index_size_in_bytes() const { return index.size_in_bytes(); }
+
+    /**
+     * Returns the size of the container in bytes, including the strings, their prefixes and offsets, and the index.
+     * @return the size of the container in bytes
+     */
+    size_t size_in_bytes() const {
+        return arena.size() + offsets.size() * sizeof(size_t) + prefixes.size() * sizeof(prefix_type)
+            + index_size_in_bytes();
     }
 };
 
@@ -876,8 +1550,10 @@ private:
  * @tparam Epsilon the Epsilon parameter for the internal @ref PGMIndex
  * @tparam EpsilonRecursive the EpsilonRecursive parameter for the internal @ref PGMIndex
  * @tparam Floating the Floating parameter for the internal @ref PGMIndex
+ * @tparam Search the last-mile search policy used on the window returned by the internal @ref PGMIndex
  */
-template<uint8_t Dimensions, typename T, size_t Epsilon, size_t EpsilonRecursive = 4, typename Floating = float>
+template<uint8_t Dimensions, typename T, size_t Epsilon, size_t EpsilonRecursive = 4, typename Floating = float,
+    typename Search = AdaptiveSearch>
 class MultidimensionalPGMIndex {
     std::vector<T> data;
     PGMIndex<T, Epsilon, EpsilonRecursive, Floating> pgm;
@@ -933,9 +1609,8 @@ public:
      */
     bool contains(const value_type &p) {
         auto zp = encode(p);
-        auto range = pgm.search(zp);
-        auto it = std::lower_bound(data.begin() + range.lo, data.begin() + range.hi, zp);
-        return it != data.end() || morton::Decode(*it) == p;
+        auto it = internal::search_range<Search>(data.begin(), pgm.search(zp), zp);
+        return it != data.end() && morton::Decode(*it) == p;
     }
 
     /**
@@ -1014,8 +1689,7 @@ public:
 
         // get 2k points around zp to make temporary answer
         auto zp = encode(p);
-        auto range = pgm.search(zp);
-        auto it = std::lower_bound(data.begin() + range.lo, data.begin() + range.hi, zp);
+        auto it = internal::search_range<Search>(data.begin(), pgm.search(zp), zp);
 
         std::vector<value_type> tmp_ans;
         for (auto i = it - k >= data.begin() ? it - k : data.begin(); i != it + k && i != data.end(); ++i)
@@ -1049,7 +1723,8 @@ public:
 private:
 
     class RangeIterator {
-        using multidimensional_pgm_type = MultidimensionalPGMIndex<Dimensions, T, Epsilon, EpsilonRecursive, Floating>;
+        using multidimensional_pgm_type =
+            MultidimensionalPGMIndex<Dimensions, T, Epsilon, EpsilonRecursive, Floating, Search>;
         using internal_iterator = typename decltype(multidimensional_pgm_type::data)::const_iterator;
 
     public:
@@ -1111,8 +1786,7 @@ private:
             if (zmin > zmax)
                 throw std::invalid_argument("min > max");
 
-            auto range = super->pgm.search(zmin);
-            this->it = std::lower_bound(super->data.begin() + range.lo, super->data.begin() + range.hi, zmin);
+            this->it = internal::search_range<Search>(super->data.begin(), super->pgm.search(zmin), zmin);
             if (this->it == super->data.end())
                 return;
 
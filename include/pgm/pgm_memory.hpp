@@ -0,0 +1,323 @@
+// This file is part of PGM-index <https://github.com/gvinciguerra/PGM-index>.
+// Copyright (c) 2021 Giorgio Vinciguerra.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "pgm_index.hpp"
+
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cctype>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace pgm {
+
+namespace internal {
+
+constexpr size_t huge_page_size = size_t(1) << 21;     ///< The size of a huge page on x86-64 and AArch64.
+constexpr size_t gigantic_page_size = size_t(1) << 30; ///< The size of a gigantic (1 GB) huge page.
+
+inline size_t round_to_pages(size_t bytes, size_t page_size) { return (bytes + page_size - 1) / page_size * page_size; }
+
+/**
+ * Asks the kernel to place the pages in [p, p + bytes) on the NUMA node @p node, if possible. Failures are ignored,
+ * since they only affect the locality of the memory.
+ */
+inline void bind_to_numa_node([[maybe_unused]] void *p, [[maybe_unused]] size_t bytes, int node) {
+#if defined(__linux__) && defined(SYS_mbind)
+    constexpr int mpol_preferred = 1;
+    constexpr size_t max_nodes = 1024;
+    if (node < 0 || size_t(node) >= max_nodes)
+        return;
+    unsigned long mask[max_nodes / (8 * sizeof(unsigned long))] = {};
+    mask[node / (8 * sizeof(unsigned long))] = 1ul << (node % (8 * sizeof(unsigned long)));
+    syscall(SYS_mbind, p, bytes, mpol_preferred, mask, max_nodes, 0);
+#endif
+}
+
+/**
+ * Maps @p bytes of anonymous memory, rounded up to a multiple of @p page_size and aligned to it.
+ *
+ * When @p page_size is larger than the base page, the mapping is first attempted on the pages reserved for hugetlbfs
+ * with @c MAP_HUGETLB. If none are available, a regular mapping is aligned to @p page_size and marked with
+ * @c madvise(MADV_HUGEPAGE), so that transparent huge pages back it when the kernel allows them.
+ * @param bytes the number of bytes to map
+ * @param page_size the size of the pages, a power of two
+ * @param node the NUMA node on which to place the memory, or -1 for the default policy
+ * @return a pointer to the mapping, or @c nullptr if the memory could not be mapped
+ */
+inline void *map_pages(size_t bytes, size_t page_size, int node = -1) {
+    auto base_page_size = size_t(sysconf(_SC_PAGESIZE));
+    page_size = std::max(page_size, base_page_size);
+    auto length = round_to_pages(bytes, page_size);
+    void *p = MAP_FAILED;
+
+#if defined(MAP_HUGETLB) && defined(MAP_HUGE_SHIFT)
+    if (page_size > base_page_size) {
+        auto flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | (__builtin_ctzll(page_size) << MAP_HUGE_SHIFT);
+        p = mmap(nullptr, length, PROT_READ | PROT_WRITE, flags, -1, 0);
+    }
+#endif
+
+    if (p == MAP_FAILED) {
+        // Over-allocate by one page and trim the unaligned ends
+        auto padded = length + (page_size > base_page_size ? page_size : 0);
+        auto q = mmap(nullptr, padded, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (q == MAP_FAILED)
+            return nullptr;
+        auto begin = (uintptr_t(q) + page_size - 1) / page_size * page_size;
+        auto head = begin - uintptr_t(q);
+        if (head)
+            munmap(q, head);
+        if (padded - head > length)
+            munmap((char *) begin + length, padded - head - length);
+        p = (void *) begin;
+#ifdef MADV_HUGEPAGE
+        if (page_size > base_page_size)
+            madvise(p, length, MADV_HUGEPAGE);
+#endif
+    }
+
+    bind_to_numa_node(p, length, node);
+    return p;
+}
+
+/** Unmaps the memory returned by @ref map_pages with the same @p bytes and @p page_size. */
+inline void unmap_pages(void *p, size_t bytes, size_t page_size) {
+    page_size = std::max(page_size, size_t(sysconf(_SC_PAGESIZE)));
+    munmap(p, round_to_pages(bytes, page_size));
+}
+
+/**
+ * Copies the elements of @p array to memory returned by @ref map_pages and makes @p array use the copy in place.
+ * Arrays smaller than half a huge page are placed on base pages, and only if they must be bound to a NUMA node.
+ */
+template<typename T, typename Allocator>
+void place_array(ReadOnlyArray<T, Allocator> &array, size_t page_size, int node) {
+    auto bytes = array.size() * sizeof(T);
+    if (bytes == 0)
+        return;
+    if (bytes < page_size / 2) {
+        if (node < 0)
+            return;
+        page_size = 0;
+    }
+
+    auto p = map_pages(bytes, page_size, node);
+    if (!p)
+        throw std::bad_alloc();
+    std::memcpy(p, array.data(), bytes);
+    std::shared_ptr<const void> keep(p, [bytes, page_size](const void *q) {
+        unmap_pages(const_cast<void *>(q), bytes, page_size);
+    });
+    array = ReadOnlyArray<T, Allocator>((const T *) p, array.size(), std::move(keep));
+}
+
+template<typename K, size_t Epsilon, size_t EpsilonRecursive, typename Floating, typename Layout>
+void place_arrays(PGMIndex<K, Epsilon, EpsilonRecursive, Floating, Layout> &index, size_t page_size, int node) {
+    if constexpr (std::is_same_v<Layout, SplitLayout>) {
+        place_array(index.keys, page_size, node);
+        place_array(index.models, page_size, node);
+    } else
+        place_array(index.segments, page_size, node);
+    place_array(index.levels_offsets, page_size, node);
+}
+
+/**
+ * Places the arrays of @p index with @ref place_array, then lets the index update the state that pointed into the old
+ * arrays, such as the pointers to the levels of a @ref FixedHeightPGMIndex.
+ */
+template<typename Index>
+void place_index(Index &index, size_t page_size, int node) {
+    place_arrays(index, page_size, node);
+    index.relocated();
+}
+
+/** Parses a list of ranges of integers in the format of the files in /sys/devices/system, such as "0-3,8,10-11". */
+inline std::vector<size_t> parse_cpu_list(const std::string &list) {
+    std::vector<size_t> result;
+    std::stringstream ss(list);
+    std::string range;
+    while (std::getline(ss, range, ',')) {
+        if (range.empty() || !std::isdigit((unsigned char) range[0]))
+            continue;
+        auto dash = range.find('-');
+        auto first = std::stoul(range.substr(0, dash));
+        auto last = dash == std::string::npos ? first : std::stoul(range.substr(dash + 1));
+        for (auto i = first; i <= last; ++i)
+            result.push_back(i);
+    }
+    return result;
+}
+
+/** Returns the contents of the first line of the file @p filename, or an empty string if it cannot be read. */
+inline std::string read_first_line(const std::string &filename) {
+    std::ifstream in(filename);
+    std::string line;
+    std::getline(in, line);
+    return line;
+}
+
+} // namespace internal
+
+/**
+ * An allocator that places large arrays on huge pages, to reduce the TLB misses of the random accesses done by the
+ * searches on the sorted keys and on the levels of a @ref DynamicPGMIndex.
+ *
+ * Allocations of at least half a page of @p PageSize bytes are mapped with @c MAP_HUGETLB if the system has reserved
+ * huge pages of that size, and otherwise with a regular mapping aligned to @p PageSize and marked with
+ * @c madvise(MADV_HUGEPAGE). Smaller allocations use the global @c operator @c new.
+ *
+ * @tparam T the type of the allocated elements
+ * @tparam PageSize the size of the huge pages, 2 MB by default or 1 GB
+ */
+template<typename T, size_t PageSize = internal::huge_page_size>
+struct HugePageAllocator {
+    using value_type = T;
+
+    template<typename U>
+    struct rebind { using other = HugePageAllocator<U, PageSize>; };
+
+    HugePageAllocator() = default;
+
+    template<typename U>
+    HugePageAllocator(const HugePageAllocator<U, PageSize> &) {}
+
+    T *allocate(size_t n) {
+        auto bytes = n * sizeof(T);
+        if (bytes < PageSize / 2)
+            return static_cast<T *>(::operator new(bytes));
+        auto p = internal::map_pages(bytes, PageSize);
+        if (!p)
+            throw std::bad_alloc();
+        return static_cast<T *>(p);
+    }
+
+    void deallocate(T *p, size_t n) {
+        auto bytes = n * sizeof(T);
+        if (bytes < PageSize / 2)
+            ::operator delete(p);
+        else
+            internal::unmap_pages(p, bytes, PageSize);
+    }
+
+    template<typename U>
+    bool operator==(const HugePageAllocator<U, PageSize> &) const { return true; }
+
+    template<typename U>
+    bool operator!=(const HugePageAllocator<U, PageSize> &) const { return false; }
+};
+
+/**
+ * Moves the segments of @p index to huge pages, where they are used in place. The index can still be copied and
+ * searched as usual, and the pages are released when the last copy is destroyed.
+ * @param index a @ref PGMIndex, or a variant derived from it
+ * @param page_size the size of the huge pages, 2 MB by default or 1 GB
+ */
+template<typename Index>
+void use_huge_pages(Index &index, size_t page_size = internal::huge_page_size) {
+    internal::place_index(index, page_size, -1);
+}
+
+/**
+ * Returns the number of NUMA nodes of the system, or 1 if the topology cannot be read.
+ * @return the number of NUMA nodes
+ */
+inline size_t numa_nodes_count() {
+    auto nodes = internal::parse_cpu_list(internal::read_first_line("/sys/devices/system/node/online"));
+    return nodes.empty() ? 1 : nodes.back() + 1;
+}
+
+/**
+ * A set of copies of an index, one per NUMA node, each one with its segments placed on (huge pages of) the memory of
+ * its node. The searches go through @ref local, which returns the copy on the node of the CPU running the caller, so
+ * that the read-only segments are never fetched across sockets.
+ *
+ * On systems with a single node, or where the topology cannot be read, there is a single copy.
+ *
+ * @tparam Index a @ref PGMIndex, or a variant derived from it
+ */
+template<typename Index>
+class NumaReplicatedIndex {
+    std::vector<Index> replicas;    ///< The ith element is the copy of the index on the ith node.
+    std::vector<uint16_t> cpu_node; ///< The ith element is the node of the ith CPU.
+
+public:
+
+    /**
+     * Constructs a copy of @p index on each NUMA node.
+     * @param index the index to replicate
+     * @param page_size the size of the pages on which the segments are placed, 2 MB by default
+     */
+    explicit NumaReplicatedIndex(const Index &index, size_t page_size = internal::huge_page_size) {
+        auto nodes = numa_nodes_count();
+        replicas.reserve(nodes);
+        for (size_t node = 0; node < nodes; ++node) {
+            replicas.push_back(index);
+            internal::place_index(replicas.back(), page_size, nodes > 1 ? int(node) : -1);
+
+            auto path = "/sys/devices/system/node/node" + std::to_string(node) + "/cpulist";
+            for (auto cpu : internal::parse_cpu_list(internal::read_first_line(path))) {
+                if (cpu >= cpu_node.size())
+                    cpu_node.resize(cpu + 1);
+                cpu_node[cpu] = node;
+            }
+        }
+    }
+
+    /**
+     * Returns the copy of the index on the NUMA node of the CPU running the caller.
+     * @return the local copy of the index
+     */
+    const Index &local() const {
+        auto cpu = sched_getcpu();
+        auto node = cpu >= 0 && size_t(cpu) < cpu_node.size() ? cpu_node[cpu] : 0;
+        return replicas[node >= 0 && size_t(node) < replicas.size() ? node : 0];
+    }
+
+    /**
+     * Returns the copy of the index on the given NUMA node.
+     * @param node the NUMA node
+     * @return the copy of the index on @p node
+     */
+    const Index &replica(size_t node) const { return replicas[node]; }
+
+    /**
+     * Returns the number of copies of the index, which is the number of NUMA nodes.
+     * @return the number of copies of the index
+     */
+    size_t replicas_count() const { return replicas.size(); }
+
+    /**
+     * Returns the approximate position and the range where @p key can be found, using the local copy of the index.
+     * @param key the value of the element to search for
+     * @return a struct with the approximate position and bounds of the range
+     */
+    template<typename K>
+    ApproxPos search(const K &key) const { return local().search(key); }
+};
+
+}
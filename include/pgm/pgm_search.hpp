@@ -0,0 +1,456 @@
+// This file is part of PGM-index <https://github.com/gvinciguerra/PGM-index>.
+// Copyright (c) 2018 Giorgio Vinciguerra.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <type_traits>
+#include <vector>
+
+#if defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h>
+#endif
+
+namespace pgm {
+
+namespace internal {
+
+/** Maximum size in bytes of a window that is scanned linearly rather than binary searched. */
+constexpr size_t linear_scan_threshold = 8 * 64;
+
+template<typename It>
+constexpr bool is_contiguous_iterator_v = std::is_pointer_v<It>
+    || std::is_same_v<It, typename std::vector<typename std::iterator_traits<It>::value_type>::iterator>
+    || std::is_same_v<It, typename std::vector<typename std::iterator_traits<It>::value_type>::const_iterator>;
+
+/**
+ * Returns the first position in the sorted range [first, last) that is not less than @p x, using a binary search
+ * whose only branch is the loop condition and that prefetches both the possible next probes.
+ */
+template<typename RandomIt, typename K>
+RandomIt branchless_lower_bound(RandomIt first, RandomIt last, const K &x) {
+    if (first == last)
+        return first;
+    auto n = std::distance(first, last);
+    while (n > 1) {
+        auto half = n / 2;
+        __builtin_prefetch(&*(first + half / 2), 0, 0);
+        __builtin_prefetch(&*(first + half + half / 2), 0, 0);
+        first = first[half] < x ? first + half : first;
+        n -= half;
+    }
+    return first + (*first < x);
+}
+
+/**
+ * Returns the number of elements less than @p x in the array [first, first + n), which is the offset of the lower bound
+ * of @p x when the array is sorted. Compares all the elements with SIMD instructions when the key type allows it.
+ */
+template<typename K>
+size_t count_less(const K *first, size_t n, const K &x) {
+    size_t i = 0;
+    size_t count = 0;
+
+#if defined(__AVX512F__)
+    if constexpr (std::is_integral_v<K> && sizeof(K) == 8) {
+        auto v = _mm512_set1_epi64((int64_t) x);
+        for (; i + 8 <= n; i += 8) {
+            auto keys = _mm512_loadu_si512((const void *) (first + i));
+            if constexpr (std::is_signed_v<K>)
+                count += __builtin_popcount(_mm512_cmplt_epi64_mask(keys, v));
+            else
+                count += __builtin_popcount(_mm512_cmplt_epu64_mask(keys, v));
+        }
+    } else if constexpr (std::is_integral_v<K> && sizeof(K) == 4) {
+        auto v = _mm512_set1_epi32((int32_t) x);
+        for (; i + 16 <= n; i += 16) {
+            auto keys = _mm512_loadu_si512((const void *) (first + i));
+            if constexpr (std::is_signed_v<K>)
+                count += __builtin_popcount(_mm512_cmplt_epi32_mask(keys, v));
+            else
+                count += __builtin_popcount(_mm512_cmplt_epu32_mask(keys, v));
+        }
+    }
+#elif defined(__AVX2__)
+    if constexpr (std::is_integral_v<K> && sizeof(K) == 8) {
+        auto flip = _mm256_set1_epi64x(std::is_signed_v<K> ? 0 : INT64_MIN);
+        auto v = _mm256_xor_si256(_mm256_set1_epi64x((int64_t) x), flip);
+        for (; i + 4 <= n; i += 4) {
+            auto keys = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *) (first + i)), flip);
+            auto mask = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(v, keys)));
+            count += __builtin_popcount(mask);
+        }
+    } else if constexpr (std::is_integral_v<K> && sizeof(K) == 4) {
+        auto flip = _mm256_set1_epi32(std::is_signed_v<K> ? 0 : INT32_MIN);
+        auto v = _mm256_xor_si256(_mm256_set1_epi32((int32_t) x), flip);
+        for (; i + 8 <= n; i += 8) {
+            auto keys = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *) (first + i)), flip);
+            auto mask = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(v, keys)));
+            count += __builtin_popcount(mask);
+        }
+    }
+#endif
+
+    for (; i < n; ++i)
+        count += first[i] < x;
+    return count;
+}
+
+/**
+ * Returns the number of consecutive keys not greater than @p x at the beginning of the @p N keys stored at the
+ * addresses @p first, @p first + @p Stride, ..., @p first + (@p N - 1) * @p Stride, so that keys after the first one
+ * greater than @p x (e.g. those of the next level of an index) do not contribute. All the keys are compared at once
+ * with SIMD instructions, loading them with gathers when they are not contiguous, and the count is derived from the
+ * trailing ones of the comparison mask. Only the @p N keys are read.
+ */
+template<size_t N, size_t Stride, typename K>
+size_t leading_not_greater(const void *first, const K &x) {
+    static_assert(N < 64);
+    [[maybe_unused]] auto bytes = static_cast<const unsigned char *>(first);
+    uint64_t mask = 0;
+
+#if defined(__AVX512F__)
+    if constexpr (std::is_integral_v<K> && sizeof(K) == 8) {
+        auto v = _mm512_set1_epi64((int64_t) x);
+        auto offsets = _mm512_setr_epi64(0, Stride, 2 * Stride, 3 * Stride, 4 * Stride, 5 * Stride, 6 * Stride,
+                                         7 * Stride);
+        for (size_t j = 0; j < N; j += 8) {
+            auto lanes = __mmask8(N - j >= 8 ? 0xFF : (1u << (N - j)) - 1);
+            __m512i keys;
+            if constexpr (Stride == sizeof(K))
+                keys = _mm512_maskz_loadu_epi64(lanes, bytes + j * Stride);
+            else
+                keys = _mm512_mask_i64gather_epi64(_mm512_setzero_si512(), lanes, offsets, bytes + j * Stride, 1);
+            __mmask8 le;
+            if constexpr (std::is_signed_v<K>)
+                le = _mm512_mask_cmple_epi64_mask(lanes, keys, v);
+            else
+                le = _mm512_mask_cmple_epu64_mask(lanes, keys, v);
+            mask |= uint64_t(le) << j;
+        }
+        return __builtin_ctzll(~mask);
+    } else if constexpr (std::is_integral_v<K> && sizeof(K) == 4) {
+        auto v = _mm512_set1_epi32((int32_t) x);
+        auto offsets = _mm512_mullo_epi32(_mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15),
+                                          _mm512_set1_epi32(Stride));
+        for (size_t j = 0; j < N; j += 16) {
+            auto lanes = __mmask16(N - j >= 16 ? 0xFFFF : (1u << (N - j)) - 1);
+            __m512i keys;
+            if constexpr (Stride == sizeof(K))
+                keys = _mm512_maskz_loadu_epi32(lanes, bytes + j * Stride);
+            else
+                keys = _mm512_mask_i32gather_epi32(_mm512_setzero_si512(), lanes, offsets, bytes + j * Stride, 1);
+            __mmask16 le;
+            if constexpr (std::is_signed_v<K>)
+                le = _mm512_mask_cmple_epi32_mask(lanes, keys, v);
+            else
+                le = _mm512_mask_cmple_epu32_mask(lanes, keys, v);
+            mask |= uint64_t(le) << j;
+        }
+        return __builtin_ctzll(~mask);
+    }
+#elif defined(__AVX2__)
+    if constexpr (std::is_integral_v<K> && sizeof(K) == 8) {
+        auto flip = _mm256_set1_epi64x(std::is_signed_v<K> ? 0 : INT64_MIN);
+        auto v = _mm256_xor_si256(_mm256_set1_epi64x((int64_t) x), flip);
+        auto offsets = _mm256_setr_epi64x(0, Stride, 2 * Stride, 3 * Stride);
+        for (size_t j = 0; j < N; j += 4) {
+            auto n = std::min<size_t>(N - j, 4);
+            auto lanes = _mm256_cmpgt_epi64(_mm256_set1_epi64x(n), _mm256_setr_epi64x(0, 1, 2, 3));
+            auto ptr = (const long long *) (bytes + j * Stride);
+            __m256i keys;
+            if constexpr (Stride == sizeof(K))
+                keys = _mm256_maskload_epi64(ptr, lanes);
+            else
+                keys = _mm256_mask_i64gather_epi64(_mm256_setzero_si256(), ptr, offsets, lanes, 1);
+            auto gt = _mm256_cmpgt_epi64(_mm256_xor_si256(keys, flip), v);
+            auto le = ~_mm256_movemask_pd(_mm256_castsi256_pd(gt)) & ((1u << n) - 1);
+            mask |= uint64_t(le) << j;
+        }
+        return __builtin_ctzll(~mask);
+    } else if constexpr (std::is_integral_v<K> && sizeof(K) == 4) {
+        auto flip = _mm256_set1_epi32(std::is_signed_v<K> ? 0 : INT32_MIN);
+        auto v = _mm256_xor_si256(_mm256_set1_epi32((int32_t) x), flip);
+        auto offsets = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(Stride));
+        for (size_t j = 0; j < N; j += 8) {
+            auto n = std::min<size_t>(N - j, 8);
+            auto lanes = _mm256_cmpgt_epi32(_mm256_set1_epi32(n), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+            auto ptr = (const int *) (bytes + j * Stride);
+            __m256i keys;
+            if constexpr (Stride == sizeof(K))
+                keys = _mm256_maskload_epi32(ptr, lanes);
+            else
+                keys = _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), ptr, offsets, lanes, 1);
+            auto gt = _mm256_cmpgt_epi32(_mm256_xor_si256(keys, flip), v);
+            auto le = ~_mm256_movemask_ps(_mm256_castsi256_ps(gt)) & ((1u << n) - 1);
+            mask |= uint64_t(le) << j;
+        }
+        return __builtin_ctzll(~mask);
+    }
+#endif
+
+    for (size_t j = 0; j < N; ++j) {
+        K key;
+        std::memcpy(&key, bytes + j * Stride, sizeof(K));
+        mask |= uint64_t(!(x < key)) << j;
+    }
+    return __builtin_ctzll(~mask);
+}
+
+/**
+ * Returns the first position in the sorted range [first, last) that is not less than @p x. Short ranges of contiguous
+ * keys are scanned linearly, the others are binary searched.
+ */
+template<typename RandomIt, typename K>
+RandomIt window_lower_bound(RandomIt first, RandomIt last, const K &x) {
+    using value_type = typename std::iterator_traits<RandomIt>::value_type;
+    if constexpr (is_contiguous_iterator_v<RandomIt> && std::is_arithmetic_v<value_type>) {
+        size_t n = std::distance(first, last);
+        if (n * sizeof(value_type) <= linear_scan_threshold)
+            return first + count_less<value_type>(&*first, n, x);
+    }
+    return branchless_lower_bound(first, last, x);
+}
+
+} // namespace internal
+
+/*
+ * Last-mile search policies. Each one finds the first element not less than a key in the window [first, last) of
+ * sorted keys returned by an index, given the position @c hint in [first, last] predicted by the index.
+ */
+
+/** Searches the window with @c std::lower_bound. */
+struct BinarySearch {
+    template<typename RandomIt, typename K>
+    static RandomIt lower_bound(RandomIt first, RandomIt last, RandomIt, const K &x) {
+        return std::lower_bound(first, last, x);
+    }
+};
+
+/** Searches the window with a binary search whose only branch is the loop condition. */
+struct BranchlessBinarySearch {
+    template<typename RandomIt, typename K>
+    static RandomIt lower_bound(RandomIt first, RandomIt last, RandomIt, const K &x) {
+        return internal::branchless_lower_bound(first, last, x);
+    }
+};
+
+/**
+ * Searches the window with an exponential search that starts from the predicted position and doubles its step towards
+ * the key, so that its cost is logarithmic in the prediction error rather than in the size of the window.
+ */
+struct ExponentialSearch {
+    template<typename RandomIt, typename K>
+    static RandomIt lower_bound(RandomIt first, RandomIt last, RandomIt hint, const K &x) {
+        if (hint != last && *hint < x) {
+            auto lo = hint + 1;
+            size_t step = 1;
+            while (size_t(std::distance(lo, last)) > step && lo[step - 1] < x) {
+                lo += step;
+                step *= 2;
+            }
+            return internal::branchless_lower_bound(lo, lo + std::min<size_t>(step, std::distance(lo, last)), x);
+        }
+
+        auto hi = hint;
+        size_t step = 1;
+        while (size_t(std::distance(first, hi)) > step && !(*(hi - step) < x)) {
+            hi -= step;
+            step *= 2;
+        }
+        auto lo = size_t(std::distance(first, hi)) > step ? hi - step + 1 : first;
+        return internal::branchless_lower_bound(lo, hi, x);
+    }
+};
+
+/**
+ * Searches the window with a few steps of interpolation search, which probe the position estimated by a linear
+ * interpolation between the keys at the ends of the window, and then with @ref AdaptiveSearch. Keys that are not
+ * arithmetic are binary searched.
+ */
+struct InterpolationSearch {
+    static constexpr size_t max_steps = 4;
+    static constexpr size_t min_window = 16;
+
+    template<typename RandomIt, typename K>
+    static RandomIt lower_bound(RandomIt first, RandomIt last, RandomIt, const K &x);
+};
+
+/**
+ * Searches the window by counting the keys less than the searched one, using SIMD instructions when the keys are
+ * contiguous integers.
+ */
+struct LinearSearch {
+    template<typename RandomIt, typename K>
+    static RandomIt lower_bound(RandomIt first, RandomIt last, RandomIt, const K &x) {
+        using value_type = typename std::iterator_traits<RandomIt>::value_type;
+        if constexpr (internal::is_contiguous_iterator_v<RandomIt> && std::is_arithmetic_v<value_type>) {
+            return first + internal::count_less<value_type>(&*first, std::distance(first, last), x);
+        } else {
+            while (first != last && *first < x)
+                ++first;
+            return first;
+        }
+    }
+};
+
+/** Scans the window with @ref LinearSearch when it spans a few cache lines, otherwise binary searches it. */
+struct AdaptiveSearch {
+    template<typename RandomIt, typename K>
+    static RandomIt lower_bound(RandomIt first, RandomIt last, RandomIt, const K &x) {
+        return internal::window_lower_bound(first, last, x);
+    }
+};
+
+template<typename RandomIt, typename K>
+RandomIt InterpolationSearch::lower_bound(RandomIt first, RandomIt last, RandomIt hint, const K &x) {
+    using value_type = typename std::iterator_traits<RandomIt>::value_type;
+    if constexpr (!std::is_arithmetic_v<value_type>) {
+        return internal::branchless_lower_bound(first, last, x);
+    } else {
+        for (size_t i = 0; i < max_steps && size_t(std::distance(first, last)) > min_window; ++i) {
+            value_type lo_key = *first;
+            value_type hi_key = *(last - 1);
+            if (!(lo_key < x))
+                return first;
+            if (hi_key < x)
+                return last;
+            auto fraction = ((long double) x - (long double) lo_key) / ((long double) hi_key - (long double) lo_key);
+            auto offset = std::min<size_t>(fraction * (std::distance(first, last) - 1), std::distance(first, last) - 1);
+            auto probe = first + offset;
+            if (*probe < x)
+                first = probe + 1;
+            else
+                last = probe;
+        }
+        return AdaptiveSearch::lower_bound(first, last, hint, x);
+    }
+}
+
+namespace internal {
+
+/**
+ * Returns the first position not less than @p x in the window of the sorted range starting at @p first that is
+ * described by @p range, a struct with the approximate position and bounds returned by an index.
+ */
+template<typename Search, typename RandomIt, typename Range, typename K>
+RandomIt search_range(RandomIt first, const Range &range, const K &x) {
+    auto lo = first + range.lo;
+    auto hi = first + range.hi;
+    auto hint = first + std::clamp<size_t>(range.pos, range.lo, range.hi);
+    return Search::lower_bound(lo, hi, hint, x);
+}
+
+/**
+ * Shrinks the window described by @p range so that it does not exceed a range of @p n keys, for example when the index
+ * was built on a range longer than the one being searched.
+ */
+template<typename Range>
+Range clamp_range(Range range, size_t n) {
+    range.hi = std::min<size_t>(range.hi, n);
+    range.lo = std::min<size_t>(range.lo, range.hi);
+    return range;
+}
+
+} // namespace internal
+
+/**
+ * Returns an iterator pointing to the first element in the sorted range [first, last) that is not less than @p key,
+ * using @p index to restrict the search to a small window of the range.
+ * @tparam Search the last-mile search policy used on the window, such as @ref ExponentialSearch
+ * @param index an index built on the range [first, last)
+ * @param first, last the range of sorted keys on which @p index was built
+ * @param key the value of the element to search for
+ * @return an iterator to the first element not less than @p key, or @p last if no such element is found
+ */
+template<typename Search = AdaptiveSearch, typename Index, typename RandomIt, typename K>
+RandomIt lower_bound(const Index &index, RandomIt first, RandomIt last, const K &key) {
+    auto range = internal::clamp_range(index.search(key), std::distance(first, last));
+    return internal::search_range<Search>(first, range, key);
+}
+
+/**
+ * Returns an iterator pointing to the first element in the sorted container @p data that is not less than @p key,
+ * using @p index to restrict the search to a small window of the container.
+ * @param index an index built on the container @p data
+ * @param data the container of sorted keys on which @p index was built
+ * @param key the value of the element to search for
+ * @return an iterator to the first element not less than @p key, or @c data.end() if no such element is found
+ */
+template<typename Search = AdaptiveSearch, typename Index, typename Container, typename K>
+auto lower_bound(const Index &index, const Container &data, const K &key) {
+    return lower_bound<Search>(index, std::begin(data), std::end(data), key);
+}
+
+/**
+ * Finds the first element not less than each key of a sorted batch in the sorted range [first, last).
+ *
+ * The ranges are computed in chunks by @c index.search_sorted_batch, which sweeps the segments of the index instead of
+ * descending it for every key. The windows of a chunk are then searched independently of each other, so that their
+ * cache misses overlap.
+ * @tparam Search the last-mile search policy used on the windows, such as @ref ExponentialSearch
+ * @param index an index built on the range [first, last) that provides @c search_sorted_batch, such as @ref PGMIndex
+ * @param first, last the range of sorted keys on which @p index was built
+ * @param keys pointer to the values of the elements to search for, sorted in non-decreasing order
+ * @param count the number of keys in the batch
+ * @param out the beginning of the destination range, where an iterator to the first element not less than each key
+ * (or @p last) is written
+ * @return an iterator past the last element written to the destination range
+ */
+template<typename Search = AdaptiveSearch, typename Index, typename RandomIt, typename K, typename OutputIt>
+OutputIt lower_bound_sorted_batch(const Index &index, RandomIt first, RandomIt last, const K *keys, size_t count,
+                                  OutputIt out) {
+    constexpr size_t chunk_size = 256;
+    decltype(index.search(*keys)) ranges[chunk_size];
+    auto n = std::distance(first, last);
+    for (size_t i = 0; i < count; i += chunk_size) {
+        auto chunk = std::min(chunk_size, count - i);
+        index.search_sorted_batch(keys + i, chunk, ranges);
+        for (size_t j = 0; j < chunk; ++j)
+            *out++ = internal::search_range<Search>(first, internal::clamp_range(ranges[j], n), keys[i + j]);
+    }
+    return out;
+}
+
+/**
+ * Returns an iterator pointing to an element equal to @p key in the sorted range [first, last).
+ * @param index an index built on the range [first, last)
+ * @param first, last the range of sorted keys on which @p index was built
+ * @param key the value of the element to search for
+ * @return an iterator to the first element equal to @p key, or @p last if no such element is found
+ */
+template<typename Search = AdaptiveSearch, typename Index, typename RandomIt, typename K>
+RandomIt find(const Index &index, RandomIt first, RandomIt last, const K &key) {
+    auto it = lower_bound<Search>(index, first, last, key);
+    return it != last && *it == key ? it : last;
+}
+
+/**
+ * Returns an iterator pointing to an element equal to @p key in the sorted container @p data.
+ * @param index an index built on the container @p data
+ * @param data the container of sorted keys on which @p index was built
+ * @param key the value of the element to search for
+ * @return an iterator to the first element equal to @p key, or @c data.end() if no such element is found
+ */
+template<typename Search = AdaptiveSearch, typename Index, typename Container, typename K>
+auto find(const Index &index, const Container &data, const K &key) {
+    return find<Search>(index, std::begin(data), std::end(data), key);
+}
+
+}
@@ -16,17 +16,23 @@
 #pragma once
 
 #include <algorithm>
+#include <cmath>
 #include <cstddef>
 #include <cstdint>
 #include <iterator>
 #include <limits>
+#include <optional>
 #include <stdexcept>
 #include <type_traits>
 #include <utility>
 #include <vector>
 
+#ifdef _OPENMP
+#include <omp.h>
+#else
 #define omp_get_num_procs() 1
 #define omp_get_max_threads() 1
+#endif
 
 namespace pgm::internal {
 
@@ -35,20 +41,155 @@ using LargeSigned = typename std::conditional_t<std::is_floating_point_v<T>,
                                                 long double,
                                                 std::conditional_t<(sizeof(T) < 8), int64_t, __int128>>;
 
+template<typename T>
+constexpr bool is_wide_integer_v = sizeof(T) > 8 && !std::is_floating_point_v<T>;
+
+/**
+ * The difference between two 128-bit integers, stored as a sign and a magnitude so that it is exact even when the
+ * operands are more than 2^127 apart.
+ */
+struct WideDelta {
+    unsigned __int128 magnitude{};
+    bool negative{};
+
+    WideDelta() = default;
+
+    template<typename T>
+    WideDelta(const T &a, const T &b)
+        : magnitude(a < b ? (unsigned __int128) b - (unsigned __int128) a : (unsigned __int128) a - (unsigned __int128) b),
+          negative(a < b) {}
+
+    explicit operator long double() const {
+        auto m = static_cast<long double>(magnitude);
+        return negative ? -m : m;
+    }
+};
+
+/** The exact product of a 128-bit and a 64-bit unsigned integer, split into its high 128 bits and low 64 bits. */
+struct WideProduct {
+    unsigned __int128 high{};
+    uint64_t low{};
+
+    WideProduct(unsigned __int128 a, uint64_t b) {
+        auto lo = (unsigned __int128) uint64_t(a) * b;
+        high = (a >> 64) * b + (lo >> 64);
+        low = uint64_t(lo);
+    }
+
+    unsigned __int128 low_bits() const { return (high << 64) | low; }
+
+    explicit operator long double() const { return std::ldexp(static_cast<long double>(high), 64) + low; }
+
+    bool operator<(const WideProduct &p) const { return high < p.high || (high == p.high && low < p.low); }
+    bool operator==(const WideProduct &p) const { return high == p.high && low == p.low; }
+};
+
+/**
+ * Returns k - origin. For 128-bit keys the difference is computed on unsigned integers, so that it does not overflow
+ * when k >= origin, however far apart the two keys are.
+ */
+template<typename K>
+auto key_delta(const K &k, const K &origin) {
+    if constexpr (is_wide_integer_v<K>)
+        return (unsigned __int128) k - (unsigned __int128) origin;
+    else
+        return k - origin;
+}
+
 template<typename X, typename Y>
 class OptimalPiecewiseLinearModel {
 private:
-    using SX = LargeSigned<X>;
+    using SX = std::conditional_t<is_wide_integer_v<X>, WideDelta, LargeSigned<X>>;
     using SY = LargeSigned<Y>;
 
+    /**
+     * Whether the differences of the ordinates, shifted by epsilon, fit in 64 bits. This holds for integers of up to 32
+     * bits and for the positions of the keys, as @ref add_point checks that 64-bit unsigned ordinates are below 2^62.
+     */
+    static constexpr bool narrow_y = std::is_integral_v<Y>
+        && (sizeof(Y) < 8 || (sizeof(Y) == 8 && std::is_unsigned_v<Y>));
+    static constexpr Y max_narrow_y = narrow_y ? Y(std::min<uint64_t>(uint64_t(1) << 62,
+                                                                      std::numeric_limits<Y>::max())) : Y();
+
+    static SX delta(const X &a, const X &b) {
+        if constexpr (is_wide_integer_v<X>)
+            return WideDelta(a, b);
+        else
+            return SX(a) - b;
+    }
+
+    /**
+     * Returns the sign of a * b - c * d. When X is a 128-bit integer, the products are computed exactly on 192 bits,
+     * so that the comparisons of slopes and the orientation tests of the hulls never overflow.
+     */
+    static int compare_products(const SY &a, const SX &b, const SX &c, const SY &d) {
+        if constexpr (is_wide_integer_v<X>) {
+            static_assert(sizeof(Y) <= 8, "The y-coordinates must fit in 64 bits");
+            auto sign = [](const SY &y, const WideDelta &x) {
+                return y == 0 || x.magnitude == 0 ? 0 : ((y < 0) != x.negative ? -1 : 1);
+            };
+            auto s1 = sign(a, b);
+            auto s2 = sign(d, c);
+            if (s1 != s2)
+                return s1 < s2 ? -1 : 1;
+            if (s1 == 0)
+                return 0;
+            WideProduct p1(b.magnitude, uint64_t(a < 0 ? -a : a));
+            WideProduct p2(c.magnitude, uint64_t(d < 0 ? -d : d));
+            auto cmp = p1 == p2 ? 0 : (p1 < p2 ? -1 : 1);
+            return s1 * cmp;
+        } else if constexpr (narrow_y) {
+            // The differences of ordinates fit in 64 bits, so that each product is a 64x64-bit multiplication for
+            // integer abscissas, and an integer-to-long double conversion that avoids a library call otherwise
+            auto l = wide_product(int64_t(a), b);
+            auto r = wide_product(int64_t(d), c);
+            return (l > r) - (l < r);
+        } else {
+            auto l = a * b;
+            auto r = c * d;
+            return (l > r) - (l < r);
+        }
+    }
+
+    template<typename T>
+    static auto wide_product(int64_t y, const T &x) {
+        if constexpr (std::is_floating_point_v<T>)
+            return y * x;
+        else if (int64_t(x) == x) // Usually the case, so that the product is a single 64x64-bit multiplication
+            return __int128(y) * int64_t(x);
+        else
+            return __int128(y) * x;
+    }
+
+    /** Returns the rounded value of y * x / d, computed exactly when X is a 128-bit integer and d is positive. */
+    static SY round_quotient(const SY &y, const WideDelta &x, const WideDelta &d) {
+        WideProduct num(x.magnitude, uint64_t(y < 0 ? -y : y));
+        auto den = d.magnitude;
+        auto negative = (y < 0) != x.negative;
+        auto estimate = static_cast<long double>(num) / static_cast<long double>(den);
+        if (estimate >= 0x1p62L)
+            return negative ? -SY(estimate) : SY(estimate);
+
+        // Fix the floating-point estimate so that q = floor(num / den), then round the remainder
+        auto q = uint64_t(estimate);
+        while (q > 0 && num < WideProduct(den, q))
+            --q;
+        while (!(num < WideProduct(den, q + 1)))
+            ++q;
+        auto r = num.low_bits() - WideProduct(den, q).low_bits();
+        q += r >= den - r;
+
+        return negative ? -SY(q) : SY(q);
+    }
+
     struct Slope {
         SX dx{};
         SY dy{};
 
-        bool operator<(const Slope &p) const { return dy * p.dx < dx * p.dy; }
-        bool operator>(const Slope &p) const { return dy * p.dx > dx * p.dy; }
-        bool operator==(const Slope &p) const { return dy * p.dx == dx * p.dy; }
-        bool operator!=(const Slope &p) const { return dy * p.dx != dx * p.dy; }
+        bool operator<(const Slope &p) const { return compare_products(dy, p.dx, dx, p.dy) < 0; }
+        bool operator>(const Slope &p) const { return compare_products(dy, p.dx, dx, p.dy) > 0; }
+        bool operator==(const Slope &p) const { return compare_products(dy, p.dx, dx, p.dy) == 0; }
+        bool operator!=(const Slope &p) const { return compare_products(dy, p.dx, dx, p.dy) != 0; }
         explicit operator long double() const { return dy / (long double) dx; }
     };
 
@@ -56,40 +197,85 @@ private:
         X x{};
         Y y{};
 
-        Slope operator-(const Point &p) const { return {SX(x) - p.x, SY(y) - p.y}; }
+        Slope operator-(const Point &p) const { return {delta(x, p.x), SY(y) - p.y}; }
+    };
+
+    /**
+     * The points of a convex hull. Points are appended and removed at the back, and those at the front are consumed
+     * when the extreme slopes move past them. The live points are a window that slides forward on a fixed buffer and
+     * is moved back to the beginning of the buffer when it reaches the end, so that the buffer stays small and hot in
+     * the cache. The buffer is enlarged only when a hull has more points than the buffer can hold.
+     */
+    class Hull {
+        std::vector<Point> buffer;
+        size_t first = 0;
+        size_t last = 0;
+
+        void make_room() {
+            if (first > 0) {
+                std::copy(buffer.begin() + first, buffer.begin() + last, buffer.begin());
+                last -= first;
+                first = 0;
+            } else
+                buffer.resize(2 * buffer.size());
+        }
+
+    public:
+        explicit Hull(size_t capacity) : buffer(std::max<size_t>(capacity, 4)) {}
+
+        size_t size() const { return last - first; }
+        const Point &operator[](size_t i) const { return buffer[first + i]; }
+        void clear() { first = last = 0; }
+        void truncate(size_t n) { last = first + n; }
+        void pop_front(size_t n) { first += n; }
+
+        void push_back(const Point &p) {
+            if (last == buffer.size())
+                make_room();
+            buffer[last++] = p;
+        }
     };
 
     const Y epsilon;
-    std::vector<Point> lower;
-    std::vector<Point> upper;
+    Hull lower;
+    Hull upper;
     X first_x = 0;
     X last_x = 0;
-    size_t lower_start = 0;
-    size_t upper_start = 0;
     size_t points_in_hull = 0;
     Point rectangle[4];
 
     auto cross(const Point &O, const Point &A, const Point &B) const {
         auto OA = A - O;
         auto OB = B - O;
-        return OA.dx * OB.dy - OA.dy * OB.dx;
+        return compare_products(OB.dy, OA.dx, OB.dx, OA.dy);
     }
 
 public:
 
     class CanonicalSegment;
 
-    explicit OptimalPiecewiseLinearModel(Y epsilon) : epsilon(epsilon), lower(), upper() {
+    explicit OptimalPiecewiseLinearModel(Y epsilon)
+        : epsilon(epsilon), lower(hull_capacity(epsilon)), upper(hull_capacity(epsilon)) {
         if (epsilon < 0)
             throw std::invalid_argument("epsilon cannot be negative");
+        if constexpr (narrow_y) {
+            if (epsilon > max_narrow_y)
+                throw std::invalid_argument("epsilon must be smaller than 2^62");
+        }
+    }
 
-        upper.reserve(1u << 16);
-        lower.reserve(1u << 16);
+    /** Returns the initial capacity of the hull buffers, which hold a few tens of points on most inputs. */
+    static size_t hull_capacity(Y epsilon) {
+        return std::min<size_t>(1u << 16, 64 + 2 * size_t(std::max<Y>(epsilon, 0)));
     }
 
     bool add_point(const X &x, const Y &y) {
         if (points_in_hull > 0 && x <= last_x)
             throw std::logic_error("Points must be increasing by x.");
+        if constexpr (narrow_y) {
+            if (y > max_narrow_y)
+                throw std::overflow_error("The ordinates must be smaller than 2^62");
+        }
 
         last_x = x;
         auto max_y = std::numeric_limits<Y>::max();
@@ -105,7 +291,6 @@ public:
             lower.clear();
             upper.push_back(p1);
             lower.push_back(p2);
-            upper_start = lower_start = 0;
             ++points_in_hull;
             return true;
         }
@@ -131,9 +316,9 @@ public:
 
         if (p1 - rectangle[1] < slope2) {
             // Find extreme slope
-            auto min = lower[lower_start] - p1;
-            auto min_i = lower_start;
-            for (auto i = lower_start + 1; i < lower.size(); i++) {
+            auto min = lower[0] - p1;
+            size_t min_i = 0;
+            for (size_t i = 1; i < lower.size(); i++) {
                 auto val = lower[i] - p1;
                 if (val > min)
                     break;
@@ -143,21 +328,21 @@ public:
 
             rectangle[1] = lower[min_i];
             rectangle[3] = p1;
-            lower_start = min_i;
+            lower.pop_front(min_i);
 
             // Hull update
             auto end = upper.size();
-            for (; end >= upper_start + 2 && cross(upper[end - 2], upper[end - 1], p1) <= 0; --end)
+            for (; end >= 2 && cross(upper[end - 2], upper[end - 1], p1) <= 0; --end)
                 continue;
-            upper.resize(end);
+            upper.truncate(end);
             upper.push_back(p1);
         }
 
         if (p2 - rectangle[0] > slope1) {
             // Find extreme slope
-            auto max = upper[upper_start] - p2;
-            auto max_i = upper_start;
-            for (auto i = upper_start + 1; i < upper.size(); i++) {
+            auto max = upper[0] - p2;
+            size_t max_i = 0;
+            for (size_t i = 1; i < upper.size(); i++) {
                 auto val = upper[i] - p2;
                 if (val < max)
                     break;
@@ -167,13 +352,13 @@ public:
 
             rectangle[0] = upper[max_i];
             rectangle[2] = p2;
-            upper_start = max_i;
+            upper.pop_front(max_i);
 
             // Hull update
             auto end = lower.size();
-            for (; end >= lower_start + 2 && cross(lower[end - 2], lower[end - 1], p2) >= 0; --end)
+            for (; end >= 2 && cross(lower[end - 2], lower[end - 1], p2) >= 0; --end)
                 continue;
-            lower.resize(end);
+            lower.truncate(end);
             lower.push_back(p2);
         }
 
@@ -229,18 +414,32 @@ public:
             return {p0.x, p0.y};
 
         auto p0p1 = p1 - p0;
-        auto a = slope1.dx * slope2.dy - slope1.dy * slope2.dx;
-        auto b = (p0p1.dx * slope2.dy - p0p1.dy * slope2.dx) / static_cast<long double>(a);
-        auto i_x = p0.x + b * slope1.dx;
-        auto i_y = p0.y + b * slope1.dy;
-        return {i_x, i_y};
+        if constexpr (is_wide_integer_v<X>) {
+            auto dx1 = static_cast<long double>(slope1.dx);
+            auto dx2 = static_cast<long double>(slope2.dx);
+            auto a = dx1 * slope2.dy - slope1.dy * dx2;
+            auto b = (static_cast<long double>(p0p1.dx) * slope2.dy - p0p1.dy * dx2) / a;
+            auto i_x = static_cast<long double>(p0.x) + b * dx1;
+            auto i_y = p0.y + b * slope1.dy;
+            return {i_x, i_y};
+        } else {
+            auto a = slope1.dx * slope2.dy - slope1.dy * slope2.dx;
+            auto b = (p0p1.dx * slope2.dy - p0p1.dy * slope2.dx) / static_cast<long double>(a);
+            auto i_x = p0.x + b * slope1.dx;
+            auto i_y = p0.y + b * slope1.dy;
+            return {i_x, i_y};
+        }
     }
 
     std::pair<long double, SY> get_floating_point_segment(const X &origin) const {
         if (one_point())
             return {0, (rectangle[0].y + rectangle[1].y) / 2};
 
-        if constexpr (std::is_integral_v<X> && std::is_integral_v<Y>) {
+        if constexpr (is_wide_integer_v<X> && std::is_integral_v<Y>) {
+            auto slope = rectangle[3] - rectangle[1];
+            auto intercept = round_quotient(slope.dy, delta(origin, rectangle[1].x), slope.dx) + rectangle[1].y;
+            return {static_cast<long double>(slope), intercept};
+        } else if constexpr (std::is_integral_v<X> && std::is_integral_v<Y>) {
             auto slope = rectangle[3] - rectangle[1];
             auto intercept_n = slope.dy * (SX(origin) - rectangle[1].x);
             auto intercept_d = slope.dx;
@@ -295,21 +494,36 @@ size_t make_segmentation(size_t n, size_t epsilon, Fin in, Fout out) {
     return ++c;
 }
 
+/**
+ * Computes the same segmentation as @ref make_segmentation by splitting the input into @p parallelism chunks that are
+ * segmented in parallel, and then by stitching the chunks together.
+ *
+ * The stitching re-segments the points starting from the last segment of a chunk. As soon as it starts a new segment
+ * at the same point where a segment of the next chunk starts, the two segmentations coincide from that point on, so the
+ * segments of the next chunk are output as they are, up to its last segment, where the re-segmentation resumes. Usually
+ * this processes only the points of a couple of segments per chunk.
+ *
+ * @param n the number of points
+ * @param epsilon the maximum error of the segments
+ * @param in a function returning the ith point
+ * @param out a function called on each segment, in order
+ * @param parallelism the number of chunks, which are processed by as many threads
+ * @return the number of segments
+ */
 template<typename Fin, typename Fout>
-size_t make_segmentation_par(size_t n, size_t epsilon, Fin in, Fout out) {
-    auto parallelism = std::min(std::min(omp_get_num_procs(), omp_get_max_threads()), 20);
-    auto chunk_size = n / parallelism;
-    auto c = 0ull;
-
-    if (parallelism == 1 || n < 1ull << 15)
+size_t make_segmentation_par(size_t n, size_t epsilon, Fin in, Fout out, int parallelism) {
+    if (parallelism <= 1 || n < size_t(parallelism))
         return make_segmentation(n, epsilon, in, out);
 
     using X = typename std::invoke_result_t<Fin, size_t>::first_type;
     using Y = typename std::invoke_result_t<Fin, size_t>::second_type;
     using canonical_segment = typename OptimalPiecewiseLinearModel<X, Y>::CanonicalSegment;
     std::vector<std::vector<canonical_segment>> results(parallelism);
+    std::vector<size_t> firsts(parallelism);
+    std::vector<size_t> lasts(parallelism);
+    auto chunk_size = n / parallelism;
 
-    #pragma omp parallel for reduction(+:c) num_threads(parallelism)
+    #pragma omp parallel for num_threads(parallelism)
     for (auto i = 0; i < parallelism; ++i) {
         auto first = i * chunk_size;
         auto last = i == parallelism - 1 ? n : first + chunk_size;
@@ -317,21 +531,83 @@ size_t make_segmentation_par(size_t n, size_t epsilon, Fin in, Fout out) {
             for (; first < last; ++first)
                 if (in(first).first != in(first - 1).first)
                     break;
-            if (first == last)
-                continue;
         }
+        firsts[i] = first;
+        lasts[i] = last;
+        if (first == last)
+            continue;
 
         auto in_fun = [in, first](auto j) { return in(first + j); };
         auto out_fun = [&results, i](const auto &cs) { results[i].emplace_back(cs); };
         results[i].reserve(chunk_size / (epsilon > 0 ? epsilon * epsilon : 16));
-        c += make_segmentation(last - first, epsilon, in_fun, out_fun);
+        make_segmentation(last - first, epsilon, in_fun, out_fun);
+    }
+
+    // Returns the position of the first point of a segment of the ith chunk
+    auto first_point = [&](int i, const canonical_segment &cs) {
+        auto x = cs.get_first_x();
+        auto first = firsts[i];
+        auto count = lasts[i] - first;
+        while (count > 0) {
+            auto half = count / 2;
+            if (in(first + half).first < x) {
+                first += half + 1;
+                count -= half + 1;
+            } else
+                count = half;
+        }
+        return first;
+    };
+
+    size_t c = 0;
+    auto h = 0;
+    for (; results[h].empty(); ++h)
+        continue;
+    for (auto it = results[h].begin(); it + 1 < results[h].end(); ++it, ++c)
+        out(*it);
+
+    OptimalPiecewiseLinearModel<X, Y> opt(epsilon);
+    auto i = first_point(h, results[h].back());
+    auto p = in(i);
+    opt.add_point(p.first, p.second);
+
+    for (++h; h < parallelism; ++h) {
+        auto &next = results[h];
+        size_t k = 0;
+        while (i + 1 < lasts[h]) {
+            auto next_p = in(++i);
+            if (next_p.first == p.first)
+                continue;
+            p = next_p;
+            if (opt.add_point(p.first, p.second))
+                continue;
+
+            out(opt.get_segment());
+            ++c;
+            while (k < next.size() && next[k].get_first_x() < p.first)
+                ++k;
+            if (k < next.size() && next[k].get_first_x() == p.first) {
+                for (; k + 1 < next.size(); ++k, ++c)
+                    out(next[k]);
+                i = first_point(h, next.back());
+                p = in(i);
+                opt.reset();
+                opt.add_point(p.first, p.second);
+                continue;
+            }
+            opt.add_point(p.first, p.second);
+        }
     }
 
-    for (auto &v : results)
-        for (auto &cs : v)
-            out(cs);
+    out(opt.get_segment());
+    return ++c;
+}
 
-    return c;
+template<typename Fin, typename Fout>
+size_t make_segmentation_par(size_t n, size_t epsilon, Fin in, Fout out) {
+    constexpr size_t min_chunk_size = 1ull << 15;
+    auto parallelism = (int) std::min<size_t>(omp_get_max_threads(), n / min_chunk_size);
+    return make_segmentation_par(n, epsilon, in, out, parallelism);
 }
 
 template<typename RandomIt>
@@ -352,3 +628,69 @@ auto make_segmentation(RandomIt first, RandomIt last, size_t epsilon) {
 }
 
 }
+
+namespace pgm {
+
+/**
+ * Computes an optimal piecewise linear approximation of a stream of points that arrive one at a time, with each point
+ * at a vertical distance of at most epsilon from its segment.
+ *
+ * Unlike @ref internal::make_segmentation, the number of points does not need to be known in advance: each call to
+ * @ref push returns the segment that the point completes, if any, and @ref flush returns the segment in progress. The
+ * segments are the same that @ref internal::make_segmentation computes on the whole sequence of points. The buffers of
+ * the convex hulls are allocated once and reused by all the segments.
+ *
+ * @tparam X the type of the abscissas, e.g. the keys
+ * @tparam Y the type of the ordinates, e.g. the positions of the keys
+ */
+template<typename X, typename Y = size_t>
+class Segmenter {
+    internal::OptimalPiecewiseLinearModel<X, Y> opt; ///< The model of the segment in progress.
+    X last_x = 0;                                    ///< The abscissa of the last point added to the model.
+    bool empty = true;                               ///< Whether the segment in progress has no points.
+
+public:
+
+    /** The type of the segments, which provides their first abscissa, slope range, slope and intercept. */
+    using segment_type = typename internal::OptimalPiecewiseLinearModel<X, Y>::CanonicalSegment;
+
+    /**
+     * Constructs a segmenter with the given maximum error.
+     * @param epsilon the maximum vertical distance of a point from its segment
+     */
+    explicit Segmenter(Y epsilon) : opt(epsilon) {}
+
+    /**
+     * Adds a point to the segment in progress. A point with the same abscissa of the previous one is ignored, as in
+     * @ref internal::make_segmentation.
+     * @param x the abscissa of the point, must not be less than the one of the previous point
+     * @param y the ordinate of the point
+     * @return the segment completed by this point, which does not include the point, or @c std::nullopt
+     */
+    std::optional<segment_type> push(const X &x, const Y &y) {
+        if (!empty && x == last_x)
+            return std::nullopt;
+        last_x = x;
+        empty = false;
+        if (opt.add_point(x, y))
+            return std::nullopt;
+        auto segment = opt.get_segment();
+        opt.add_point(x, y);
+        return segment;
+    }
+
+    /**
+     * Completes the segment in progress. The next point pushed starts a new segment.
+     * @return the segment in progress, or @c std::nullopt if no point was pushed after the last flush
+     */
+    std::optional<segment_type> flush() {
+        if (empty)
+            return std::nullopt;
+        empty = true;
+        auto segment = opt.get_segment();
+        opt.reset();
+        return segment;
+    }
+};
+
+}
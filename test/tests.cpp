@@ -15,15 +15,21 @@
 
 #include "catch.hpp"
 #include "pgm/morton_nd.hpp"
+#include "pgm/pgm_coroutine.hpp"
 #include "pgm/pgm_index.hpp"
+#include "pgm/pgm_index_concurrent.hpp"
 #include "pgm/pgm_index_dynamic.hpp"
 #include "pgm/pgm_index_variants.hpp"
+#include "pgm/pgm_memory.hpp"
+#include "pgm/pgm_search.hpp"
 #include "pgm/piecewise_linear_model.hpp"
 #include "utils.hpp"
 
 #include <algorithm>
+#include <atomic>
 #include <cstdint>
 #include <cstdio>
+#include <cstring>
 #include <cmath>
 #include <functional>
 #include <iterator>
@@ -31,6 +37,7 @@
 #include <map>
 #include <random>
 #include <string>
+#include <thread>
 #include <tuple>
 #include <utility>
 #include <vector>
@@ -83,6 +90,112 @@ TEMPLATE_TEST_CASE("Segmentation algorithm", "", float, double, uint32_t, uint64
     }
 }
 
+TEMPLATE_TEST_CASE("Parallel segmentation algorithm", "", float, double, uint32_t, uint64_t) {
+    auto epsilon = GENERATE(8, 32, 128);
+    auto parallelism = GENERATE(2, 7, 64);
+    auto data = generate_data<TestType>(1000000);
+
+    using canonical_segment = typename pgm::internal::OptimalPiecewiseLinearModel<TestType, size_t>::CanonicalSegment;
+    std::vector<canonical_segment> sequential;
+    std::vector<canonical_segment> parallel;
+    auto in_fun = [&](auto i) { return std::pair<TestType, size_t>(data[i], i); };
+    auto c1 = pgm::internal::make_segmentation(data.size(), epsilon, in_fun, [&](auto cs) { sequential.push_back(cs); });
+    auto c2 = pgm::internal::make_segmentation_par(data.size(), epsilon, in_fun, [&](auto cs) { parallel.push_back(cs); },
+                                                   parallelism);
+
+    REQUIRE(c1 == sequential.size());
+    REQUIRE(c2 == parallel.size());
+    REQUIRE(c1 == c2);
+    for (size_t i = 0; i < sequential.size(); ++i) {
+        auto x = sequential[i].get_first_x();
+        REQUIRE(x == parallel[i].get_first_x());
+        REQUIRE(sequential[i].get_floating_point_segment(x) == parallel[i].get_floating_point_segment(x));
+    }
+}
+
+TEMPLATE_TEST_CASE("Parallel segmentation of fewer points than chunks", "", float, uint64_t) {
+    auto n = GENERATE(0, 1, 3, 63);
+    auto data = generate_data<TestType>(n);
+
+    using canonical_segment = typename pgm::internal::OptimalPiecewiseLinearModel<TestType, size_t>::CanonicalSegment;
+    std::vector<canonical_segment> sequential;
+    std::vector<canonical_segment> parallel;
+    auto in_fun = [&](auto i) { return std::pair<TestType, size_t>(data[i], i); };
+    auto c1 = pgm::internal::make_segmentation(data.size(), 8, in_fun, [&](auto cs) { sequential.push_back(cs); });
+    auto c2 = pgm::internal::make_segmentation_par(data.size(), 8, in_fun, [&](auto cs) { parallel.push_back(cs); }, 64);
+
+    REQUIRE(c1 == c2);
+    REQUIRE(parallel.size() == c2);
+    for (size_t i = 0; i < sequential.size(); ++i)
+        REQUIRE(sequential[i].get_first_x() == parallel[i].get_first_x());
+}
+
+TEMPLATE_TEST_CASE("Streaming segmentation", "", float, double, uint32_t, uint64_t) {
+    auto epsilon = GENERATE(8, 32, 128);
+    auto data = generate_data<TestType>(1000000);
+    auto expected = pgm::internal::make_segmentation(data.begin(), data.end(), epsilon);
+
+    pgm::Segmenter<TestType> segmenter(epsilon);
+    std::vector<typename pgm::Segmenter<TestType>::segment_type> segments;
+    REQUIRE_FALSE(segmenter.flush());
+    for (size_t i = 0; i < data.size(); ++i)
+        if (auto segment = segmenter.push(data[i], i))
+            segments.push_back(*segment);
+    segments.push_back(*segmenter.flush());
+    REQUIRE_FALSE(segmenter.flush());
+
+    REQUIRE(segments.size() == expected.size());
+    for (size_t i = 0; i < segments.size(); ++i) {
+        auto x = segments[i].get_first_x();
+        REQUIRE(x == expected[i].get_first_x());
+        REQUIRE(segments[i].get_floating_point_segment(x) == expected[i].get_floating_point_segment(x));
+    }
+
+    // A flush in the middle of the stream splits the segment in progress, and the segmenter can be reused afterwards
+    auto middle = data.size() / 2;
+    std::vector<typename pgm::Segmenter<TestType>::segment_type> split;
+    for (size_t i = 0; i < data.size(); ++i) {
+        if (i == middle)
+            split.push_back(*segmenter.flush());
+        if (auto segment = segmenter.push(data[i], i))
+            split.push_back(*segment);
+    }
+    split.push_back(*segmenter.flush());
+
+    std::vector<typename pgm::Segmenter<TestType>::segment_type> expected_split;
+    auto out_fun = [&](auto cs) { expected_split.push_back(cs); };
+    auto prefix_fun = [&](auto i) { return std::pair<TestType, size_t>(data[i], i); };
+    auto suffix_fun = [&](auto i) { return std::pair<TestType, size_t>(data[middle + i], middle + i); };
+    pgm::internal::make_segmentation(middle, epsilon, prefix_fun, out_fun);
+    pgm::internal::make_segmentation(data.size() - middle, epsilon, suffix_fun, out_fun);
+
+    REQUIRE(split.size() == expected_split.size());
+    for (size_t i = 0; i < split.size(); ++i) {
+        auto x = split[i].get_first_x();
+        REQUIRE(x == expected_split[i].get_first_x());
+        REQUIRE(split[i].get_floating_point_segment(x) == expected_split[i].get_floating_point_segment(x));
+    }
+}
+
+#ifdef _OPENMP
+TEMPLATE_TEST_CASE_SIG("PGM-index parallel construction", "",
+                       ((typename T, size_t E1, size_t E2), T, E1, E2),
+                       (uint32_t, 8, 4), (uint64_t, 32, 4), (uint64_t, 128, 0)) {
+    auto data = generate_data<T>(2000000);
+    auto threads = omp_get_max_threads();
+
+    omp_set_num_threads(1);
+    pgm::PGMIndex<T, E1, E2> sequential(data.begin(), data.end());
+    omp_set_num_threads(13);
+    pgm::PGMIndex<T, E1, E2> parallel(data.begin(), data.end());
+    omp_set_num_threads(threads);
+
+    REQUIRE(parallel.size_in_bytes() == sequential.size_in_bytes());
+    REQUIRE(parallel.height() == sequential.height());
+    test_index(parallel, data);
+}
+#endif
+
 TEMPLATE_TEST_CASE_SIG("PGM-index", "",
                        ((typename T, size_t E1, size_t E2), T, E1, E2),
                        (uint32_t, 8, 0), (uint32_t, 32, 0), (uint32_t, 128, 0),
@@ -93,6 +206,432 @@ TEMPLATE_TEST_CASE_SIG("PGM-index", "",
     test_index(index, data);
 }
 
+TEMPLATE_TEST_CASE("PGM-index with duplicate maximum keys", "", int32_t, int64_t, uint64_t) {
+    auto data = generate_data<TestType>(100000);
+    data.resize(data.size() - 10);
+    data.insert(data.end(), 10, std::numeric_limits<TestType>::max());
+    pgm::PGMIndex<TestType, 8, 4> index(data.begin(), data.end());
+
+    // max() is the sentinel key, so only the keys before the run of max() are searched
+    for (auto q : {data.front(), data[data.size() / 2], data[data.size() - 11]}) {
+        auto range = index.search(q);
+        auto k = std::lower_bound(data.begin() + range.lo, data.begin() + range.hi, q);
+        REQUIRE(k != data.end());
+        REQUIRE(*k == q);
+    }
+}
+
+TEMPLATE_TEST_CASE_SIG("PGM-index streaming builder", "",
+                       ((typename T, size_t E1, size_t E2), T, E1, E2),
+                       (uint32_t, 8, 0), (uint32_t, 32, 4), (uint64_t, 8, 4), (uint64_t, 128, 4)) {
+    auto data = generate_data<T>(1000000);
+    std::vector<T> few_distinct(data.size());
+    std::transform(data.begin(), data.end(), few_distinct.begin(), [](auto x) { return x / 2048 * 2048; });
+    std::vector<T> with_sentinel(data.begin(), data.begin() + 1000);
+    with_sentinel.push_back(std::numeric_limits<T>::max());
+    std::vector<T> only_sentinel(1, std::numeric_limits<T>::max());
+
+    pgm::PGMIndexBuilder<T, E1, E2> builder;
+    for (auto *keys : {&data, &few_distinct, &with_sentinel, &only_sentinel}) {
+        for (auto k : *keys)
+            builder.push(k);
+        REQUIRE(builder.size() == keys->size());
+        auto index = builder.finish();
+        REQUIRE(builder.size() == 0);
+
+        pgm::PGMIndex<T, E1, E2> expected(keys->begin(), keys->end());
+        REQUIRE(index.n == expected.n);
+        REQUIRE(index.first_key == expected.first_key);
+        REQUIRE(index.levels_offsets == expected.levels_offsets);
+        for (size_t i = 0; i < expected.segments.size(); ++i) {
+            REQUIRE(index.segments[i].key == expected.segments[i].key);
+            REQUIRE(index.segments[i].slope == expected.segments[i].slope);
+            REQUIRE(index.segments[i].intercept == expected.segments[i].intercept);
+        }
+    }
+
+    auto index = builder.finish();
+    REQUIRE(index.segments_count() == 0);
+}
+
+TEMPLATE_TEST_CASE_SIG("PGM-index with fixed-point slopes", "",
+                       ((typename T, size_t E, typename M), T, E, M),
+                       (uint32_t, 8, uint32_t), (uint32_t, 64, uint64_t), (int32_t, 32, uint32_t),
+                       (uint64_t, 8, uint32_t), (uint64_t, 128, uint64_t), (int64_t, 32, uint32_t)) {
+    for (long double slope : {0.l, 1e-12l, 0.001l, 0.5l, 1.l, 3.75l, 12345.678l}) {
+        pgm::FixedPointSlope<M> fixed(slope);
+        REQUIRE(std::abs((long double) fixed - slope) <= slope * 0x1p-30);
+        for (uint32_t delta : {0u, 1u, 1000u, 123456789u})
+            REQUIRE(std::abs((long double) (fixed * delta) - slope * delta) <= 1 + slope * delta * 0x1p-30);
+    }
+
+    std::vector<T> data;
+    for (auto x : generate_data<uint32_t>(2000000))
+        data.push_back(T(x) - (std::is_signed_v<T> ? T(1000000) : T(0)));
+
+    using slope_type = pgm::FixedPointSlope<M>;
+    pgm::PGMIndex<T, E, 4, slope_type> index(data.begin(), data.end());
+    pgm::PGMIndex<T, E, 4, slope_type, pgm::SplitLayout> split(data.begin(), data.end());
+    test_index(index, data);
+    test_index(split, data);
+
+    for (size_t i = 0; i < data.size(); i += 7) {
+        auto q = data[i];
+        auto expected = std::lower_bound(data.begin(), data.end(), q);
+        for (auto range : {index.search(q), split.search(q)}) {
+            REQUIRE(range.lo <= size_t(std::distance(data.begin(), expected)));
+            REQUIRE(size_t(std::distance(data.begin(), expected)) < range.hi);
+        }
+    }
+}
+
+TEMPLATE_TEST_CASE_SIG("PGM-index split layout", "",
+                       ((typename T, size_t E1, size_t E2), T, E1, E2),
+                       (uint32_t, 8, 0), (uint32_t, 32, 4), (uint64_t, 8, 4), (uint64_t, 128, 4), (uint64_t, 256, 256)) {
+    auto data = generate_data<T>(2000000);
+    pgm::PGMIndex<T, E1, E2, float, pgm::SplitLayout> index(data.begin(), data.end());
+    test_index(index, data);
+
+    pgm::PGMIndex<T, E1, E2> interleaved(data.begin(), data.end());
+    REQUIRE(index.segments_count() == interleaved.segments_count());
+    REQUIRE(index.height() == interleaved.height());
+    REQUIRE(reinterpret_cast<uintptr_t>(index.keys.data()) % 64 == 0);
+    REQUIRE(reinterpret_cast<uintptr_t>(index.models.data()) % 64 == 0);
+
+    std::vector<pgm::ApproxPos> results(data.size() / 100);
+    index.search_batch(data.data(), results.size(), results.data());
+    for (size_t i = 0; i < results.size(); ++i)
+        REQUIRE(results[i].pos == interleaved.search(data[i]).pos);
+}
+
+TEMPLATE_TEST_CASE_SIG("PGM-index batch search", "",
+                       ((typename T, size_t E1, size_t E2), T, E1, E2),
+                       (uint32_t, 8, 0), (uint64_t, 8, 4), (uint64_t, 32, 4), (uint64_t, 256, 256)) {
+    auto data = generate_data<T>(1000000);
+    pgm::PGMIndex<T, E1, E2> index(data.begin(), data.end());
+
+    auto rand = std::bind(std::uniform_int_distribution<size_t>(0, data.size() - 1), std::mt19937{42});
+    std::vector<T> queries(10003);
+    std::generate(queries.begin(), queries.end(), [&] { return data[rand()]; });
+    queries.push_back(std::numeric_limits<T>::min());
+    queries.push_back(data.back() + 42);
+
+    std::vector<pgm::ApproxPos> results(queries.size());
+    index.search_batch(queries.data(), queries.size(), results.data());
+    for (size_t i = 0; i < queries.size(); ++i) {
+        auto expected = index.search(queries[i]);
+        REQUIRE(results[i].pos == expected.pos);
+        REQUIRE(results[i].lo == expected.lo);
+        REQUIRE(results[i].hi == expected.hi);
+    }
+}
+
+template<typename Index, typename T>
+void test_sorted_batch(const Index &index, const std::vector<T> &data) {
+    std::mt19937 engine(42);
+    for (auto stride : {1, 3, 1000, 100000}) {
+        std::vector<T> queries;
+        queries.push_back(std::numeric_limits<T>::min());
+        for (size_t i = engine() % stride; i < data.size(); i += 1 + engine() % stride)
+            queries.push_back(data[i] + T(engine() % 2));
+        queries.push_back(data.back() + 42);
+        queries.push_back(data[data.size() / 2]); // Breaks the sorted order on purpose
+        queries.push_back(data[data.size() / 2 + 1]);
+
+        std::vector<pgm::ApproxPos> results(queries.size());
+        index.search_sorted_batch(queries.data(), queries.size(), results.data());
+        std::vector<typename std::vector<T>::const_iterator> iterators(queries.size());
+        pgm::lower_bound_sorted_batch(index, data.begin(), data.end(), queries.data(), queries.size(),
+                                      iterators.data());
+        for (size_t i = 0; i < queries.size(); ++i) {
+            auto expected = index.search(queries[i]);
+            REQUIRE(results[i].pos == expected.pos);
+            REQUIRE(results[i].lo == expected.lo);
+            REQUIRE(results[i].hi == expected.hi);
+            REQUIRE(iterators[i] == std::lower_bound(data.begin(), data.end(), queries[i]));
+        }
+    }
+}
+
+TEMPLATE_TEST_CASE_SIG("PGM-index sorted batch search", "",
+                       ((typename T, size_t E1, size_t E2), T, E1, E2),
+                       (uint32_t, 8, 0), (uint64_t, 8, 4), (uint64_t, 32, 4), (uint64_t, 256, 256)) {
+    auto data = generate_data<T>(1000000);
+    test_sorted_batch(pgm::PGMIndex<T, E1, E2>(data.begin(), data.end()), data);
+    test_sorted_batch(pgm::PGMIndex<T, E1, E2, float, pgm::SplitLayout>(data.begin(), data.end()), data);
+    test_sorted_batch(pgm::TightPGMIndex<T, E1, E2>(data.begin(), data.end()), data);
+}
+
+#ifdef PGM_COROUTINES_ENABLED
+TEMPLATE_TEST_CASE_SIG("PGM-index interleaved lookups", "",
+                       ((typename T, size_t E1, size_t E2, typename L), T, E1, E2, L),
+                       (uint32_t, 8, 0, pgm::InterleavedLayout), (uint64_t, 8, 4, pgm::InterleavedLayout),
+                       (uint64_t, 32, 4, pgm::SplitLayout), (uint64_t, 256, 256, pgm::InterleavedLayout)) {
+    auto data = generate_data<T>(1000000);
+    pgm::PGMIndex<T, E1, E2, float, L> index(data.begin(), data.end());
+
+    auto rand = std::bind(std::uniform_int_distribution<size_t>(0, data.size() - 1), std::mt19937{42});
+    std::vector<T> queries(10003);
+    std::generate(queries.begin(), queries.end(), [&] { return data[rand()] + (rand() % 2); });
+    queries.push_back(std::numeric_limits<T>::min());
+    queries.push_back(data.back() + 42);
+
+    for (size_t in_flight : {1, 3, 16}) {
+        std::vector<size_t> completed(queries.size());
+        pgm::run_interleaved(queries.size(), in_flight,
+                             [&](size_t i) { return pgm::search_task(index, queries[i]); },
+                             [&](size_t i, const pgm::ApproxPos &result) {
+                                 auto expected = index.search(queries[i]);
+                                 REQUIRE(result.pos == expected.pos);
+                                 REQUIRE(result.lo == expected.lo);
+                                 REQUIRE(result.hi == expected.hi);
+                                 ++completed[i];
+                             });
+        REQUIRE(std::all_of(completed.begin(), completed.end(), [](auto c) { return c == 1; }));
+
+        auto make = [&](size_t i) { return pgm::lower_bound_task(index, data.begin(), data.end(), queries[i]); };
+        pgm::run_interleaved(queries.size(), in_flight, make,
+                             [&](size_t i, auto it) {
+                                 REQUIRE(it == std::lower_bound(data.begin(), data.end(), queries[i]));
+                             });
+    }
+
+    std::string tmp_filename = "tmp.interleaved.pgm";
+    {
+        pgm::MappedPGMIndex<T, E1> mapped(data.begin(), data.end(), tmp_filename);
+        pgm::run_interleaved(queries.size(), 8,
+                             [&](size_t i) { return pgm::lower_bound_task(mapped, queries[i]); },
+                             [&](size_t i, auto it) { REQUIRE(it == mapped.lower_bound(queries[i])); });
+    }
+    std::remove(tmp_filename.c_str());
+}
+#endif
+
+TEMPLATE_TEST_CASE_SIG("PGM-index lower_bound and find", "",
+                       ((typename T, size_t E), T, E),
+                       (int32_t, 8), (uint32_t, 8), (uint32_t, 256), (int64_t, 8), (uint64_t, 16), (uint64_t, 256),
+                       (__int128, 8), (__int128, 128)) {
+    std::vector<T> data;
+    for (auto x : generate_data<uint64_t>(1000000))
+        data.push_back(T(x) - (std::is_signed_v<T> ? T(5000) : T(0)));
+
+    pgm::PGMIndex<T, E> index(data.begin(), data.end());
+    auto rand = std::bind(std::uniform_int_distribution<size_t>(0, data.size() - 1), std::mt19937{42});
+
+    for (auto i = 1; i <= 10000; ++i) {
+        auto q = data[rand()] + T(i % 2);
+        auto expected = std::lower_bound(data.begin(), data.end(), q);
+        REQUIRE(pgm::lower_bound(index, data, q) == expected);
+        REQUIRE(pgm::find(index, data, q) == (expected != data.end() && *expected == q ? expected : data.end()));
+        REQUIRE(pgm::lower_bound(index, data.data(), data.data() + data.size(), q) - data.data()
+                    == std::distance(data.begin(), expected));
+    }
+
+    REQUIRE(pgm::lower_bound(index, data, data.back() + 1) == data.end());
+    REQUIRE(pgm::lower_bound(index, data, std::numeric_limits<T>::min()) == data.begin());
+}
+
+TEMPLATE_TEST_CASE("Last-mile search policies", "", pgm::BinarySearch, pgm::BranchlessBinarySearch,
+                   pgm::ExponentialSearch, pgm::InterpolationSearch, pgm::LinearSearch, pgm::AdaptiveSearch) {
+    std::vector<uint32_t> window = {1, 3, 3, 3, 4, 8, 8, 9, 15, 16, 16, 16, 16, 20, 21, 22, 30, 40, 40, 41};
+    for (uint32_t x = 0; x <= 42; ++x) {
+        auto expected = std::lower_bound(window.begin(), window.end(), x);
+        for (auto hint = window.begin(); hint <= window.end(); ++hint)
+            REQUIRE(TestType::lower_bound(window.begin(), window.end(), hint, x) == expected);
+    }
+
+    auto data = generate_data<uint64_t>(1000000);
+    pgm::PGMIndex<uint64_t, 64> index(data.begin(), data.end());
+    auto rand = std::bind(std::uniform_int_distribution<size_t>(0, data.size() - 1), std::mt19937{42});
+    for (auto i = 1; i <= 10000; ++i) {
+        auto q = data[rand()] + i % 2;
+        auto expected = std::lower_bound(data.begin(), data.end(), q);
+        REQUIRE(pgm::lower_bound<TestType>(index, data, q) == expected);
+        auto found = expected != data.end() && *expected == q;
+        REQUIRE(pgm::find<TestType>(index, data, q) == (found ? expected : data.end()));
+    }
+
+    std::string tmp_filename = "tmp.policy.pgm";
+    pgm::MappedPGMIndex<uint64_t, 32, 4, float, TestType> mapped(data.begin(), data.end(), tmp_filename);
+    pgm::DynamicPGMIndex<uint64_t, uint64_t, pgm::PGMIndex<uint64_t, 16>, TestType> dynamic;
+    std::vector<uint64_t> sample;
+    for (size_t i = 0; i < data.size(); i += 10)
+        sample.push_back(data[i]);
+    sample.erase(std::unique(sample.begin(), sample.end()), sample.end());
+    for (auto x : sample)
+        dynamic.insert_or_assign(x, x / 2);
+
+    for (auto i = 1; i <= 10000; ++i) {
+        auto q = data[rand()] + i % 2;
+        auto expected = std::lower_bound(data.begin(), data.end(), q);
+        REQUIRE(std::distance(mapped.begin(), mapped.lower_bound(q)) == std::distance(data.begin(), expected));
+
+        auto expected_sample = std::lower_bound(sample.begin(), sample.end(), q);
+        auto it = dynamic.lower_bound(q);
+        REQUIRE((it == dynamic.end()) == (expected_sample == sample.end()));
+        if (it != dynamic.end())
+            REQUIRE(it->first == *expected_sample);
+        REQUIRE((dynamic.find(q) != dynamic.end()) == std::binary_search(sample.begin(), sample.end(), q));
+    }
+    std::remove(tmp_filename.c_str());
+}
+
+/** Packs the first 12 characters of @p s into a 128-bit key, as done by the examples reading string keys from files. */
+template<typename T>
+T pack_string_key(const std::string &s) {
+    T key = 0;
+    auto key_ptr = (char *) &key + sizeof(T) - 1 - 4;
+    for (size_t i = 0; i < std::min<size_t>(s.size(), 12); ++i, --key_ptr)
+        *key_ptr = s[i];
+    return key;
+}
+
+template<typename T>
+std::vector<T> generate_wide_data(size_t n) {
+    std::mt19937_64 engine(42);
+    std::function<T()> shn_keys = [engine]() mutable {
+        std::string s = "SHN";
+        for (auto i = 0; i < 9; ++i)
+            s += "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz"[engine() % 62];
+        return pack_string_key<T>(s);
+    };
+    std::function<T()> shifted_keys = [engine]() mutable { return T(engine() % 100000000) << 90; };
+    std::function<T()> full_range_keys = [engine]() mutable { return T((unsigned __int128) engine() << 64 | engine()); };
+    auto rand = GENERATE_COPY(shn_keys, shifted_keys, full_range_keys);
+
+    std::vector<T> data(n);
+    std::generate(data.begin(), data.end(), rand);
+    std::sort(data.begin(), data.end());
+    return data;
+}
+
+TEMPLATE_TEST_CASE_SIG("PGM-index on 128-bit keys", "",
+                       ((typename T, size_t E), T, E),
+                       (__int128, 8), (__int128, 64), (unsigned __int128, 8), (unsigned __int128, 256)) {
+    auto data = generate_wide_data<T>(1000000);
+    pgm::PGMIndex<T, E> index(data.begin(), data.end());
+    pgm::PGMIndex<T, E, 4, float, pgm::SplitLayout> split(data.begin(), data.end());
+
+    for (size_t i = 0; i < data.size(); ++i) {
+        if (i > 0 && data[i] == data[i - 1])
+            continue;
+        auto range = index.search(data[i]);
+        REQUIRE(range.lo <= i);
+        REQUIRE(i < range.hi);
+        REQUIRE(split.search(data[i]).pos == range.pos);
+    }
+}
+
+template<typename T, size_t E, size_t H = 1>
+void test_fixed_height_index(const std::vector<T> &data, size_t height) {
+    if constexpr (H > 8)
+        FAIL("Height " << height << " is not tested");
+    else if (height != H)
+        test_fixed_height_index<T, E, H + 1>(data, height);
+    else {
+        pgm::FixedHeightPGMIndex<T, E, H> index(data.begin(), data.end());
+        test_index(index, data);
+
+        auto copy = index;
+        test_index(copy, data);
+
+        using wrong_height_type = pgm::FixedHeightPGMIndex<T, E, H + 1>;
+        REQUIRE_THROWS_AS(wrong_height_type(data.begin(), data.end()), std::invalid_argument);
+    }
+}
+
+TEMPLATE_TEST_CASE_SIG("Fixed-height PGM-index", "",
+                       ((typename T, size_t E), T, E), (uint32_t, 8), (uint64_t, 32), (uint64_t, 128)) {
+    auto data = generate_data<T>(2000000);
+    test_fixed_height_index<T, E>(data, pgm::PGMIndex<T, E>(data.begin(), data.end()).height());
+}
+
+template<typename T, size_t N, size_t Stride>
+void test_leading_not_greater(const void *first, const std::vector<T> &keys) {
+    for (size_t i = 0; i <= N; ++i) {
+        for (auto q : {T(keys[i] - 1), keys[i], T(keys[i] + 1)}) {
+            size_t expected = 0;
+            while (expected < N && keys[expected] <= q)
+                ++expected;
+            REQUIRE(pgm::internal::leading_not_greater<N, Stride>(first, q) == expected);
+        }
+    }
+}
+
+TEMPLATE_TEST_CASE("SIMD descent of the upper levels", "", int32_t, uint32_t, int64_t, uint64_t) {
+    // The keys of a level followed by those of the next level, which restart from a smaller value
+    std::vector<TestType> keys(64);
+    auto base = std::is_signed_v<TestType> ? TestType(-1000) : TestType(1000);
+    for (size_t i = 0; i < keys.size(); ++i)
+        keys[i] = i < 40 ? TestType(base + TestType(7 * i)) : TestType(base + TestType(3 * (i - 40)));
+    keys.back() = std::numeric_limits<TestType>::max();
+
+    struct Entry {
+        TestType key;
+        float slope;
+        int32_t intercept;
+    };
+    std::vector<Entry> entries(keys.size());
+    for (size_t i = 0; i < keys.size(); ++i)
+        entries[i] = {keys[i], 1.f, int32_t(i)};
+
+    for (size_t offset : {0, 20, 30, 38}) {
+        std::vector<TestType> window(keys.begin() + offset, keys.end());
+        test_leading_not_greater<TestType, 2, sizeof(TestType)>(keys.data() + offset, window);
+        test_leading_not_greater<TestType, 10, sizeof(TestType)>(keys.data() + offset, window);
+        test_leading_not_greater<TestType, 18, sizeof(TestType)>(keys.data() + offset, window);
+        test_leading_not_greater<TestType, 2, sizeof(Entry)>(entries.data() + offset, window);
+        test_leading_not_greater<TestType, 10, sizeof(Entry)>(entries.data() + offset, window);
+        test_leading_not_greater<TestType, 18, sizeof(Entry)>(entries.data() + offset, window);
+    }
+
+    auto data = generate_data<TestType>(1000000);
+    test_index(pgm::PGMIndex<TestType, 16, 0>(data.begin(), data.end()), data);
+    test_index(pgm::PGMIndex<TestType, 64, 4, float, pgm::SplitLayout>(data.begin(), data.end()), data);
+    test_fixed_height_index<TestType, 32>(data, pgm::PGMIndex<TestType, 32>(data.begin(), data.end()).height());
+}
+
+template<typename Index, typename = void>
+struct is_saveable : std::false_type {};
+
+template<typename Index>
+struct is_saveable<Index, std::void_t<decltype(pgm::save_index(std::declval<const Index &>(), ""))>>
+    : std::true_type {};
+
+TEMPLATE_TEST_CASE_SIG("Tight PGM-index", "",
+                       ((typename T, size_t E1, size_t E2), T, E1, E2),
+                       (uint32_t, 8, 0), (uint32_t, 32, 4), (uint64_t, 64, 4), (uint64_t, 512, 4), (double, 32, 4)) {
+    auto data = generate_data<T>(1000000);
+    pgm::TightPGMIndex<T, E1, E2> index(data.begin(), data.end());
+    pgm::PGMIndex<T, E1, E2> loose(data.begin(), data.end());
+    test_index(index, data);
+    REQUIRE(index.average_window_width() <= 2 * E1 + 2);
+
+    size_t width = 0;
+    for (auto &x : data) {
+        auto range = index.search(x);
+        width += range.hi - range.lo;
+    }
+    REQUIRE(index.average_window_width() == double(width) / data.size());
+    REQUIRE(index.size_in_bytes() > loose.size_in_bytes());
+    STATIC_REQUIRE_FALSE(is_saveable<pgm::TightPGMIndex<T, E1, E2>>::value);
+    STATIC_REQUIRE(is_saveable<pgm::PGMIndex<T, E1, E2>>::value);
+
+    std::mt19937 engine(42);
+    std::uniform_real_distribution<double> distribution(double(data.front()), double(data.back()) + 10);
+    for (auto i = 0; i < 100000; ++i) {
+        auto q = i % 2 ? T(distribution(engine)) : data[engine() % data.size()] + T(i % 4 == 0);
+        auto range = index.search(q);
+        auto expected = loose.search(q);
+        auto j = (size_t) std::distance(data.begin(), std::lower_bound(data.begin(), data.end(), q));
+        REQUIRE(range.pos == expected.pos);
+        REQUIRE(range.lo >= expected.lo);
+        REQUIRE(range.hi <= expected.hi);
+        REQUIRE(range.lo <= j);
+        REQUIRE(j <= range.hi);
+    }
+}
+
 TEMPLATE_TEST_CASE_SIG("Compressed PGM-index", "", ((size_t E), E), 8, 32, 128) {
     auto data = generate_data<uint32_t>(2000000);
     pgm::CompressedPGMIndex<uint32_t, E> index(data);
@@ -137,6 +676,7 @@ TEMPLATE_TEST_CASE_SIG("Mapped PGM-index", "", ((size_t E), E), 8, 32, 128) {
 
     {
         pgm::MappedPGMIndex<uint32_t, E> index(tmp_filename);
+        REQUIRE(index.segments.is_borrowed());
         for (auto i = 1; i <= 5000; ++i) {
             auto q = random_query();
             REQUIRE(index.count(q) == (size_t) std::count(data.begin(), data.end(), q));
@@ -146,6 +686,117 @@ TEMPLATE_TEST_CASE_SIG("Mapped PGM-index", "", ((size_t E), E), 8, 32, 128) {
     std::remove(tmp_filename.c_str());
 }
 
+TEMPLATE_TEST_CASE_SIG("PGM-index serialization", "",
+                       ((typename T, size_t E1, size_t E2), T, E1, E2),
+                       (uint32_t, 8, 4), (uint64_t, 32, 4), (uint64_t, 128, 0)) {
+    std::string tmp_filename = "tmp.index.pgm";
+    auto data = generate_data<T>(1000000);
+
+    SECTION("Interleaved layout") {
+        pgm::PGMIndex<T, E1, E2> index(data.begin(), data.end());
+        pgm::save_index(index, tmp_filename);
+        auto loaded = pgm::load_index<decltype(index)>(tmp_filename);
+        REQUIRE(loaded.segments.is_borrowed());
+        REQUIRE(reinterpret_cast<uintptr_t>(loaded.segments.data()) % pgm::internal::index_file_alignment == 0);
+        REQUIRE(loaded.n == index.n);
+        REQUIRE(loaded.levels_offsets == index.levels_offsets);
+        REQUIRE(loaded.size_in_bytes() == index.size_in_bytes());
+        test_index(loaded, data);
+
+        auto copy = loaded;
+        loaded = {};
+        test_index(copy, data);
+    }
+
+    SECTION("Split layout") {
+        pgm::PGMIndex<T, E1, E2, float, pgm::SplitLayout> index(data.begin(), data.end());
+        pgm::save_index(index, tmp_filename);
+        auto loaded = pgm::load_index<decltype(index)>(tmp_filename);
+        REQUIRE(loaded.keys.is_borrowed());
+        REQUIRE(loaded.keys == index.keys);
+        test_index(loaded, data);
+    }
+
+    SECTION("Fixed height") {
+        pgm::PGMIndex<T, E1, E2> index(data.begin(), data.end());
+        pgm::save_index(index, tmp_filename);
+        if constexpr (E2 == 0) {
+            auto loaded = pgm::load_index<pgm::FixedHeightPGMIndex<T, E1, 1, E2>>(tmp_filename);
+            test_index(loaded, data);
+        } else {
+            REQUIRE(index.height() > 1);
+            REQUIRE_THROWS(pgm::load_index<pgm::FixedHeightPGMIndex<T, E1, 1, E2>>(tmp_filename));
+        }
+    }
+
+    SECTION("Mismatching types") {
+        pgm::save_index(pgm::PGMIndex<T, E1, E2>(data.begin(), data.end()), tmp_filename);
+        REQUIRE_THROWS(pgm::load_index<pgm::PGMIndex<T, E1 + 1, E2>>(tmp_filename));
+        REQUIRE_THROWS(pgm::load_index<pgm::PGMIndex<T, E1, E2, double>>(tmp_filename));
+        REQUIRE_THROWS(pgm::load_index<pgm::PGMIndex<int64_t, E1, E2>>(tmp_filename));
+        REQUIRE_THROWS(pgm::load_index<pgm::PGMIndex<T, E1, E2, float, pgm::SplitLayout>>(tmp_filename));
+        REQUIRE_THROWS(pgm::load_index<pgm::PGMIndex<T, E1, E2>>("missing.index.pgm"));
+    }
+
+    SECTION("Corrupt sizes") {
+        pgm::save_index(pgm::PGMIndex<T, E1, E2>(data.begin(), data.end()), tmp_filename);
+        pgm::internal::IndexFileHeader header;
+        auto file = std::fopen(tmp_filename.c_str(), "r+b");
+        REQUIRE(std::fread(&header, sizeof(header), 1, file) == 1);
+        // A size whose product with the element size wraps around to a value smaller than the file
+        auto section = pgm::internal::IndexFileHeader::segments_section;
+        header.sizes[section] = std::numeric_limits<uint64_t>::max() / header.segment_bytes + 1;
+        std::rewind(file);
+        REQUIRE(std::fwrite(&header, sizeof(header), 1, file) == 1);
+        std::fclose(file);
+        REQUIRE_THROWS(pgm::load_index<pgm::PGMIndex<T, E1, E2>>(tmp_filename));
+    }
+
+    std::remove(tmp_filename.c_str());
+}
+
+TEMPLATE_TEST_CASE_SIG("String PGM-index", "", ((size_t E), E), 8, 64) {
+    std::mt19937_64 engine(42);
+    auto random_string = [&](std::string prefix, size_t length, const char *alphabet) {
+        while (prefix.size() < length)
+            prefix += alphabet[engine() % std::strlen(alphabet)];
+        return prefix;
+    };
+    auto alphanumeric = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz";
+
+    // SHN-style keys, keys sharing 16-byte prefixes, short keys with duplicates
+    auto kind = GENERATE(0, 1, 2);
+    std::vector<std::string> data(200000);
+    for (auto &s : data) {
+        if (kind == 0)
+            s = random_string("SHN", 12, alphanumeric);
+        else if (kind == 1)
+            s = random_string("SHN" + std::to_string(engine() % 100) + "-common-prefix-", 30, alphanumeric);
+        else
+            s = random_string("", 1 + engine() % 3, "ab\xff");
+    }
+    std::sort(data.begin(), data.end());
+
+    pgm::StringPGMIndex<E> index(data.begin(), data.end());
+    REQUIRE(index.size() == data.size());
+    STATIC_REQUIRE_FALSE(is_saveable<pgm::StringPGMIndex<E>>::value);
+
+    for (auto i = 1; i <= 10000; ++i) {
+        auto q = i % 2 ? data[engine() % data.size()] : random_string("SHN", 3 + engine() % 40, alphanumeric);
+        if (kind == 2 && i % 2 == 0)
+            q = random_string("", 1 + engine() % 4, "ab\xff");
+        auto lb = std::lower_bound(data.begin(), data.end(), q);
+        auto ub = std::upper_bound(data.begin(), data.end(), q);
+        REQUIRE(index.lower_bound(q) == (size_t) std::distance(data.begin(), lb));
+        REQUIRE(index.upper_bound(q) == (size_t) std::distance(data.begin(), ub));
+        REQUIRE(index.contains(q) == (lb != data.end() && *lb == q));
+        REQUIRE(index.count(q) == (size_t) std::distance(lb, ub));
+    }
+
+    for (size_t i = 0; i < data.size(); i += 97)
+        REQUIRE(index[i] == data[i]);
+}
+
 TEMPLATE_TEST_CASE("Dynamic PGM-index", "", uint32_t*, uint32_t, std::string) {
     using time_type = uint32_t;
     auto make_key = std::bind(std::uniform_int_distribution<uint32_t>(0, 1000000000), std::mt19937{42});
@@ -246,6 +897,373 @@ TEMPLATE_TEST_CASE("Dynamic PGM-index", "", uint32_t*, uint32_t, std::string) {
     }
 }
 
+TEST_CASE("Dynamic PGM-index with background merges", "") {
+    auto rand = std::bind(std::uniform_int_distribution<uint32_t>(0, 1000000), std::mt19937{42});
+    std::vector<std::pair<uint32_t, uint32_t>> bulk(GENERATE(0, 100000));
+    std::generate(bulk.begin(), bulk.end(), [&] { return std::make_pair(rand(), rand()); });
+    std::sort(bulk.begin(), bulk.end());
+    bulk.erase(std::unique(bulk.begin(), bulk.end(), [](auto &a, auto &b) { return a.first == b.first; }), bulk.end());
+
+    pgm::DynamicPGMIndex<uint32_t, uint32_t> pgm(bulk.begin(), bulk.end(), GENERATE(2, 8));
+    std::map<uint32_t, uint32_t> map(bulk.begin(), bulk.end());
+    pgm.enable_background_merges(GENERATE(1, 4, 64));
+    REQUIRE_THROWS_AS(pgm.enable_background_merges(0), std::invalid_argument);
+
+    auto check = [&] {
+        REQUIRE(pgm.size() == map.size());
+        auto it = pgm.begin();
+        for (auto[k, v] : map) {
+            REQUIRE(it->first == k);
+            REQUIRE(it->second == v);
+            ++it;
+        }
+        REQUIRE(it == pgm.end());
+
+        for (int i = 0; i < 1000; ++i) {
+            auto q = rand();
+            auto expected = map.lower_bound(q);
+            auto lb = pgm.lower_bound(q);
+            REQUIRE((lb == pgm.end()) == (expected == map.end()));
+            if (expected != map.end())
+                REQUIRE(lb->first == expected->first);
+            REQUIRE((pgm.find(q) != pgm.end()) == (map.find(q) != map.end()));
+        }
+
+        auto lo = rand();
+        auto range_result = pgm.range(lo, lo + 10000);
+        REQUIRE(range_result.size() == size_t(std::distance(map.lower_bound(lo), map.upper_bound(lo + 10000))));
+    };
+
+    for (int round = 0; round < 5; ++round) {
+        for (int i = 0; i < 50000; ++i) {
+            auto k = rand();
+            if (i % 4 == 0) {
+                pgm.erase(k);
+                map.erase(k);
+            } else {
+                pgm.insert_or_assign(k, i);
+                map.insert_or_assign(k, i);
+            }
+        }
+        check();
+    }
+
+    pgm.wait_merges();
+    check();
+
+    // A copy merges synchronously and is independent of the original
+    auto copy = pgm;
+    for (int i = 0; i < 50000; ++i)
+        copy.insert_or_assign(rand(), i);
+    check();
+    REQUIRE(copy.size() >= pgm.size());
+    for (auto[k, v] : map)
+        REQUIRE(copy.find(k) != copy.end());
+}
+
+TEST_CASE("Dynamic PGM-index filters", "") {
+    auto rand = std::bind(std::uniform_int_distribution<uint64_t>(0, 1ull << 40), std::mt19937{42});
+    std::vector<std::pair<uint64_t, uint64_t>> items(100000);
+    std::generate(items.begin(), items.end(), [&] { return std::make_pair(rand() & ~1ull, 0); });
+    std::sort(items.begin(), items.end());
+
+    pgm::internal::BlockedBloomFilter filter(items.begin(), items.end(), 10);
+    size_t false_positives = 0;
+    for (auto[k, v] : items) {
+        REQUIRE(filter.may_contain(pgm::internal::hash_key(k)));
+        false_positives += filter.may_contain(pgm::internal::hash_key(k + 1));
+    }
+    REQUIRE(false_positives < items.size() / 50);
+    REQUIRE(filter.size_in_bytes() <= items.size() * 10 / 8 + 32);
+
+    // Equal keys hash the same even if their padding bytes differ, as in the 80-bit long double of x86
+    if (std::numeric_limits<long double>::digits == 64 && sizeof(long double) > 10) {
+        long double value = 1.5L;
+        long double padded[2];
+        unsigned char bytes[2][sizeof(long double)];
+        std::memset(bytes[0], 0x00, sizeof(long double));
+        std::memset(bytes[1], 0xff, sizeof(long double));
+        for (auto i : {0, 1}) {
+            std::memcpy(bytes[i], &value, 10);
+            std::memcpy(&padded[i], bytes[i], sizeof(long double));
+        }
+        REQUIRE(padded[0] == padded[1]);
+        REQUIRE(pgm::internal::hash_key(padded[0]) == pgm::internal::hash_key(padded[1]));
+    }
+    REQUIRE(pgm::internal::hash_key(-0.0) == pgm::internal::hash_key(0.0));
+
+    pgm::DynamicPGMIndex<long double, uint64_t> long_doubles;
+    for (size_t i = 0; i < 10000; ++i)
+        long_doubles.insert_or_assign((long double) items[i].first / 3, i);
+    for (size_t i = 0; i < 10000; ++i) {
+        auto key = (long double) items[i].first / 3;
+        REQUIRE(long_doubles.find(key) != long_doubles.end());
+    }
+
+    pgm::DynamicPGMIndex<uint64_t, uint64_t> filtered(uint8_t(2), uint8_t(0), uint8_t(0), uint8_t(10));
+    pgm::DynamicPGMIndex<uint64_t, uint64_t> unfiltered(uint8_t(2), uint8_t(0), uint8_t(0), uint8_t(0));
+    if (GENERATE(false, true)) {
+        filtered.enable_background_merges();
+        unfiltered.enable_background_merges();
+    }
+    for (size_t i = 0; i < items.size(); ++i) {
+        filtered.insert_or_assign(items[i].first, i);
+        unfiltered.insert_or_assign(items[i].first, i);
+        if (i % 3 == 0) {
+            filtered.erase(items[i / 2].first);
+            unfiltered.erase(items[i / 2].first);
+        }
+    }
+    filtered.wait_merges();
+    REQUIRE(filtered.index_size_in_bytes() > unfiltered.index_size_in_bytes() + items.size());
+
+    for (auto[k, v] : items) {
+        for (auto q : {k, k + 1}) {
+            auto it = filtered.find(q);
+            auto expected = unfiltered.find(q);
+            REQUIRE((it == filtered.end()) == (expected == unfiltered.end()));
+            if (it != filtered.end())
+                REQUIRE(it->second == expected->second);
+        }
+    }
+}
+
+TEST_CASE("Dynamic PGM-index bulk insertions", "") {
+    auto rand = std::bind(std::uniform_int_distribution<uint32_t>(0, 1000000), std::mt19937{42});
+    pgm::DynamicPGMIndex<uint32_t, uint32_t> pgm(GENERATE(2, 8));
+    std::map<uint32_t, uint32_t> map;
+    if (GENERATE(false, true))
+        pgm.enable_background_merges(4);
+
+    for (auto batch_size : {1, 10, 500, 100000, 3000, 200000}) {
+        // Unsorted batches, with duplicate keys whose last occurrence wins
+        std::vector<std::pair<uint32_t, uint32_t>> batch(batch_size);
+        std::generate(batch.begin(), batch.end(), [&] { return std::make_pair(rand() % 500000, rand()); });
+        if (batch_size % 2)
+            std::stable_sort(batch.begin(), batch.end(), [](auto &a, auto &b) { return a.first < b.first; });
+        pgm.insert_bulk(batch.begin(), batch.end());
+        for (auto[k, v] : batch)
+            map[k] = v;
+
+        for (int i = 0; i < 5000; ++i) {
+            auto k = rand();
+            if (i % 3 == 0) {
+                pgm.erase(k);
+                map.erase(k);
+            } else {
+                pgm.insert_or_assign(k, i);
+                map.insert_or_assign(k, i);
+            }
+        }
+
+        REQUIRE(pgm.size() == map.size());
+        auto it = pgm.begin();
+        for (auto[k, v] : map) {
+            REQUIRE(it->first == k);
+            REQUIRE(it->second == v);
+            ++it;
+        }
+        for (int i = 0; i < 1000; ++i) {
+            auto q = rand();
+            auto found = pgm.find(q);
+            REQUIRE((found != pgm.end()) == (map.find(q) != map.end()));
+            if (found != pgm.end())
+                REQUIRE(found->second == map[q]);
+        }
+    }
+}
+
+TEST_CASE("Dynamic PGM-index range cursor", "") {
+    auto rand = std::bind(std::uniform_int_distribution<uint32_t>(0, 100000), std::mt19937{42});
+    pgm::DynamicPGMIndex<uint32_t, uint32_t> pgm(GENERATE(2, 8));
+    std::map<uint32_t, uint32_t> map;
+    if (GENERATE(false, true))
+        pgm.enable_background_merges(4);
+
+    auto cursor = pgm.range_cursor(0, 0);
+    REQUIRE(cursor.next() == nullptr);
+
+    for (int i = 0; i < 200000; ++i) {
+        auto k = rand();
+        if (i % 4 == 0) {
+            pgm.erase(k);
+            map.erase(k);
+        } else {
+            pgm.insert_or_assign(k, i);
+            map.insert_or_assign(k, i);
+        }
+
+        if (i % 10000 == 0) {
+            auto lo = rand();
+            auto hi = lo + rand() % 20000;
+            auto first = map.lower_bound(lo);
+            auto last = map.upper_bound(hi);
+
+            cursor.seek(lo, hi);
+            for (auto it = first; it != last; ++it) {
+                auto item = cursor.next();
+                REQUIRE(item != nullptr);
+                REQUIRE(item->first == it->first);
+                REQUIRE(item->second == it->second);
+            }
+            REQUIRE(cursor.next() == nullptr);
+
+            std::pair<uint32_t, uint32_t> chunk[7];
+            auto range = pgm.range(lo, hi);
+            auto it = range.begin();
+            auto c = pgm.range_cursor(lo, hi);
+            for (size_t n; (n = c.next_chunk(chunk, 7)) != 0; it += n)
+                REQUIRE(std::equal(chunk, chunk + n, it));
+            REQUIRE(it == range.end());
+            REQUIRE(range.size() == size_t(std::distance(first, last)));
+        }
+    }
+
+    REQUIRE_THROWS(pgm.range_cursor(2, 1));
+}
+
+TEST_CASE("Concurrent Dynamic PGM-index", "") {
+    auto rand = std::bind(std::uniform_int_distribution<uint32_t>(0, 1000000), std::mt19937{42});
+    std::vector<std::pair<uint32_t, uint32_t>> bulk(GENERATE(0, 100000));
+    std::generate(bulk.begin(), bulk.end(), [&] { return std::make_pair(rand(), rand()); });
+    std::sort(bulk.begin(), bulk.end());
+    bulk.erase(std::unique(bulk.begin(), bulk.end(), [](auto &a, auto &b) { return a.first == b.first; }), bulk.end());
+
+    pgm::ConcurrentDynamicPGMIndex<uint32_t, uint32_t> pgm(bulk.begin(), bulk.end(), GENERATE(2, 8));
+    std::map<uint32_t, uint32_t> map(bulk.begin(), bulk.end());
+
+    for (int round = 0; round < 3; ++round) {
+        auto old_snapshot = pgm.snapshot();
+        auto old_size = map.size();
+
+        for (int i = 0; i < 50000; ++i) {
+            auto k = rand();
+            if (i % 4 == 0) {
+                pgm.erase(k);
+                map.erase(k);
+            } else {
+                pgm.insert_or_assign(k, i);
+                map.insert_or_assign(k, i);
+            }
+        }
+
+        auto snapshot = pgm.snapshot();
+        REQUIRE(old_snapshot.size() == old_size);
+        REQUIRE(snapshot.size() == map.size());
+        for (int i = 0; i < 1000; ++i) {
+            auto q = rand();
+            auto expected = map.lower_bound(q);
+            auto lb = snapshot.lower_bound(q);
+            REQUIRE((lb == nullptr) == (expected == map.end()));
+            if (expected != map.end())
+                REQUIRE(lb->first == expected->first);
+            auto found = pgm.find(q);
+            REQUIRE(found.has_value() == (map.find(q) != map.end()));
+            if (found)
+                REQUIRE(*found == map[q]);
+        }
+
+        auto lo = rand();
+        auto range_result = pgm.range(lo, lo + 10000);
+        auto map_it = map.lower_bound(lo);
+        for (auto[k, v] : range_result) {
+            REQUIRE(k == map_it->first);
+            REQUIRE(v == map_it->second);
+            ++map_it;
+        }
+        REQUIRE(map_it == map.upper_bound(lo + 10000));
+    }
+
+    // Readers must see a prefix of the keys inserted in order by the writer
+    pgm::ConcurrentDynamicPGMIndex<uint32_t, uint32_t> sequential;
+    std::atomic<bool> done(false);
+    std::atomic<size_t> errors(0);
+    std::vector<std::thread> readers;
+    for (auto t = 0; t < 3; ++t) {
+        readers.emplace_back([&, t] {
+            std::mt19937 generator(t);
+            while (!done) {
+                auto snapshot = sequential.snapshot();
+                auto q = generator() % 100000;
+                auto it = snapshot.find(q);
+                errors += it && it->second != q * 2;
+                errors += it && q > 0 && !snapshot.find(q - 1);
+            }
+        });
+    }
+    for (uint32_t i = 0; i < 100000; ++i)
+        sequential.insert_or_assign(i, i * 2);
+    done = true;
+    for (auto &r : readers)
+        r.join();
+    REQUIRE(errors == 0);
+    REQUIRE(sequential.snapshot().size() == 100000);
+}
+
+template<typename T, size_t E, size_t H = 1>
+void test_fixed_height_on_huge_pages(const std::vector<T> &data, size_t height) {
+    if constexpr (H > 8)
+        FAIL("Height " << height << " is not tested");
+    else if (height != H)
+        test_fixed_height_on_huge_pages<T, E, H + 1>(data, height);
+    else {
+        pgm::FixedHeightPGMIndex<T, E, H> index(data.begin(), data.end());
+        REQUIRE(index.segments.size() * sizeof(index.segments[0]) >= (1 << 20));
+
+        auto placed = index;
+        pgm::use_huge_pages(placed);
+        REQUIRE(placed.segments.is_borrowed());
+        test_index(placed, data);
+
+        pgm::NumaReplicatedIndex replicated(index);
+        for (size_t i = 0; i < replicated.replicas_count(); ++i)
+            REQUIRE(replicated.replica(i).segments.is_borrowed());
+        for (size_t i = 0; i < data.size(); i += 101)
+            REQUIRE(replicated.search(data[i]).pos == index.search(data[i]).pos);
+    }
+}
+
+TEMPLATE_TEST_CASE_SIG("PGM-index on huge pages", "",
+                       ((typename T, size_t E), T, E), (uint32_t, 8), (uint64_t, 8), (uint64_t, 64)) {
+    auto generated = generate_data<T>(2000000);
+    std::vector<T, pgm::HugePageAllocator<T>> data(generated.begin(), generated.end());
+    REQUIRE(reinterpret_cast<uintptr_t>(data.data()) % (size_t(1) << 21) == 0);
+
+    pgm::PGMIndex<T, E> index(data.begin(), data.end());
+    auto placed = index;
+    pgm::use_huge_pages(placed);
+    auto segments_bytes = index.segments.size() * sizeof(index.segments[0]);
+    REQUIRE(std::memcmp(placed.segments.data(), index.segments.data(), segments_bytes) == 0);
+    REQUIRE(placed.segments.is_borrowed() == (segments_bytes >= (1 << 20)));
+    test_index(placed, data);
+
+    pgm::PGMIndex<T, E, 4, float, pgm::SplitLayout> split(data.begin(), data.end());
+    pgm::use_huge_pages(split);
+    test_index(split, data);
+
+    pgm::NumaReplicatedIndex replicated(index);
+    REQUIRE(replicated.replicas_count() == pgm::numa_nodes_count());
+    for (size_t i = 0; i < data.size(); i += 101)
+        REQUIRE(replicated.search(data[i]).pos == index.search(data[i]).pos);
+
+    // Random keys with a small epsilon give more than 1 MB of segments, which are then moved to huge pages
+    std::vector<T> sparse(4000000);
+    std::mt19937_64 engine(42);
+    for (auto &x : sparse)
+        x = T(engine() % (std::numeric_limits<T>::max() / 2));
+    std::sort(sparse.begin(), sparse.end());
+    test_fixed_height_on_huge_pages<T, 2>(sparse, pgm::PGMIndex<T, 2>(sparse.begin(), sparse.end()).height());
+
+    pgm::DynamicPGMIndex<T, T, pgm::PGMIndex<T, E>, pgm::BranchlessBinarySearch, pgm::HugePageAllocator<T>> dynamic;
+    std::map<T, T> map;
+    for (size_t i = 0; i < 300000; ++i) {
+        dynamic.insert_or_assign(data[i * 3], T(i));
+        map[data[i * 3]] = T(i);
+    }
+    for (size_t i = 0; i < 300000; i += 7)
+        REQUIRE(dynamic.find(data[i * 3])->second == map[data[i * 3]]);
+}
+
 #ifdef MORTON_ND_BMI2_ENABLED
 
 TEMPLATE_TEST_CASE_SIG("Multidimensional PGM-index", "",
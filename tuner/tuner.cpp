@@ -21,6 +21,7 @@
 template<typename K>
 void run_tuner(args::ValueFlag<size_t> &time,
                args::ValueFlag<size_t> &space,
+               args::ValueFlagList<size_t> &estimate,
                args::ValueFlag<double> &tol,
                args::ValueFlag<float> &ratio,
                args::Positional<std::string> &file);
@@ -29,7 +30,8 @@ int main(int argc, char **argv) {
     using namespace args;
     ArgumentParser p("Space-time trade-off tuner for the PGM-index. \n\nThis program lets you specify a maximum space "
                      "and get the PGM-index minimising the query time within that space. Or, it lets you specify a "
-                     "maximum query time and get the PGM-index minimising the space.");
+                     "maximum query time and get the PGM-index minimising the space. Or, it lets you estimate the "
+                     "space and construction time of the PGM-index for some epsilons without building it.");
     p.helpParams.flagindent = 2;
     p.helpParams.helpindent = 25;
     p.helpParams.progindent = 0;
@@ -43,6 +45,7 @@ int main(int argc, char **argv) {
     Group g(p, "OPERATION MODES:", args::Group::Validators::Xor, args::Options::Required);
     ValueFlag<size_t> time(g, "ns", "Specify a time to minimise the space", {'t', "time"});
     ValueFlag<size_t> space(g, "bytes", "Specify a space to minimise the time", {'s', "space"});
+    ValueFlagList<size_t> estimate(g, "eps", "Specify an epsilon to estimate (repeatable)", {'e', "estimate"});
 
     Group t(p, "INPUT DATA OPTIONS:", args::Group::Validators::Xor, args::Options::Required);
     Flag u64(t, "", "Input file contains unsigned 64-bit ints", {'U', "u64"});
@@ -71,18 +74,19 @@ int main(int argc, char **argv) {
     global_verbose = verbose.Get();
 
     if (i64.Get())
-        run_tuner<int64_t>(time, space, tol, ratio, file);
+        run_tuner<int64_t>(time, space, estimate, tol, ratio, file);
     if (u64.Get())
-        run_tuner<uint64_t>(time, space, tol, ratio, file);
+        run_tuner<uint64_t>(time, space, estimate, tol, ratio, file);
     if (i32.Get())
-        run_tuner<int32_t>(time, space, tol, ratio, file);
+        run_tuner<int32_t>(time, space, estimate, tol, ratio, file);
     if (u32.Get())
-        run_tuner<uint32_t>(time, space, tol, ratio, file);
+        run_tuner<uint32_t>(time, space, estimate, tol, ratio, file);
 }
 
 template<typename K>
 void run_tuner(args::ValueFlag<size_t> &time,
                args::ValueFlag<size_t> &space,
+               args::ValueFlagList<size_t> &estimate,
                args::ValueFlag<double> &tol,
                args::ValueFlag<float> &ratio,
                args::Positional<std::string> &file) {
@@ -93,6 +97,21 @@ void run_tuner(args::ValueFlag<size_t> &time,
     auto hi_eps = data.size() / 2;
     auto minimize_space = time.Matched();
 
+    if (estimate.Matched()) {
+        std::printf("Dataset: %zu entries\n", data.size());
+        std::printf("%s\n", std::string(80, '-').c_str());
+        std::printf("%-19s %-19s %-19s %-19s\n", "Epsilon", "Segments", "Space (KiB)", "Construction (s)");
+        std::printf("%s\n", std::string(80, '-').c_str());
+        for (auto &e : estimate_index_stats(data, estimate.Get())) {
+            auto kib = e.bytes / double(1u << 10u);
+            std::printf("%-19zu %-19zu %-19.2f %-19.2f", e.epsilon, e.segments_count, kib, e.construction_ns * 1.e-9);
+            if (global_verbose)
+                std::printf("\t↝ height=%zu method=%s", e.height, e.method);
+            std::printf("\n");
+        }
+        return;
+    }
+
     std::printf("Dataset: %zu entries\n", data.size());
     if (minimize_space)
         std::printf("Max time: %zu±%.0f ns\n", time.Get(), time.Get() * tol.Get());
@@ -23,7 +23,9 @@
 #include <cstdint>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <iterator>
+#include <limits>
 #include <memory>
 #include <string>
 #include <tuple>
@@ -139,6 +141,168 @@ auto fit_segments_count_model(const std::vector<IndexStats> &all_index_stats) {
     return std::make_pair(a, b);
 }
 
+/*------- SAMPLING-BASED ESTIMATION -------*/
+
+/** The stats of a PGM-index extrapolated from samples of the data, without building the index. */
+struct IndexEstimate {
+    size_t epsilon;
+    size_t segments_count;
+    size_t height;
+    size_t bytes;
+    size_t construction_ns;
+    const char *method; ///< How segments_count was obtained: "exact", "sampled" or "fit".
+};
+
+/** The segmentation of runs of evenly-spaced keys sampled from the data. */
+template<typename K>
+class SampleSegmentation {
+    const std::vector<K> &data;
+    pgm::Segmenter<K, size_t> segmenter;
+
+public:
+    size_t segments = 0; ///< The number of segments that end before the end of their run.
+    size_t span = 0;     ///< The number of positions covered by these segments.
+
+    SampleSegmentation(const std::vector<K> &data, size_t epsilon) : data(data), segmenter(epsilon) {}
+
+    /**
+     * Segments the keys at the positions first + j * stride for j in [0, count), except a trailing max() sentinel,
+     * mapped to points as in the construction of the index, and completes the last segment, which is truncated by the
+     * end of the run.
+     * @return the number of segments of the run, including the truncated one
+     */
+    size_t add_run(size_t first, size_t count, size_t stride) {
+        auto n = data.size();
+        auto last_n = pgm::internal::first_level_size(data.begin(), data.end());
+        auto start = first;
+        size_t run_segments = 0;
+        for (size_t j = 0, i = first; j < count && i < last_n; ++j, i += stride) {
+            if (segmenter.push(pgm::internal::first_level_key(data.begin(), n, i), i)) {
+                span += i - start;
+                start = i;
+                ++run_segments;
+            }
+        }
+        segments += run_segments;
+        return run_segments + bool(segmenter.flush());
+    }
+};
+
+/**
+ * Estimates the number of segments, the size and the construction time of a PGM-index on @p data for each of the given
+ * epsilons, by segmenting samples of about @p sample_size keys.
+ *
+ * The sample takes at most one key every epsilon/4 positions, so that the keys between two sampled ones are close to
+ * the segments through them. If such a sample is smaller than the data, it is made of runs of consecutive sampled keys
+ * centred in equal parts of the data, and the segments count is extrapolated from the density of the segments in the
+ * runs, counting half a segment for the one truncated by the end of each run. The epsilons whose segments are too
+ * long for the runs to complete enough of them are extrapolated with @ref fit_segments_count_model from the other
+ * estimates. The upper levels are estimated in the same way, since the first keys of the segments of a level are about
+ * a key every n/segments positions. The construction time is sequential and is extrapolated from the time taken to
+ * segment a block of consecutive keys.
+ *
+ * @tparam Floating the floating-point type of the slopes of the index
+ * @param data the sorted keys
+ * @param epsilons the values of epsilon of the last level to estimate
+ * @param epsilon_recursive the value of epsilon of the upper levels
+ * @param sample_size the number of keys sampled for each epsilon, 0 to sample one key every 4096
+ * @return the estimated stats for each value in @p epsilons
+ */
+template<typename K, typename Floating = float>
+std::vector<IndexEstimate> estimate_index_stats(const std::vector<K> &data, const std::vector<size_t> &epsilons,
+                                                size_t epsilon_recursive = PGM_EPSILON_RECURSIVE,
+                                                size_t sample_size = 0) {
+    const size_t min_sample_size = 1u << 16;
+    const size_t runs = 16;
+    const size_t min_segments = 8;
+    auto n = data.size();
+    auto m = std::min(n, sample_size ? sample_size : std::max(n / 4096, min_sample_size));
+
+    // Returns the segments count estimated on a sample of about the given number of keys, and how it was obtained
+    auto sample_segments = [&](size_t epsilon, size_t keys) -> std::pair<size_t, const char *> {
+        auto max_stride = std::max<size_t>(1, epsilon / 4);
+        if (n <= keys * max_stride) {
+            auto stride = (n + keys - 1) / keys;
+            auto count = SampleSegmentation<K>(data, epsilon).add_run(0, (n + stride - 1) / stride, stride);
+            return {count, stride == 1 ? "exact" : "sampled"};
+        }
+
+        SampleSegmentation<K> sample(data, epsilon);
+        auto run_keys = keys / runs;
+        auto run_span = run_keys * max_stride;
+        for (size_t i = 0; i < runs; ++i)
+            sample.add_run(n / runs * i + (n / runs - run_span) / 2, run_keys, max_stride);
+        auto count = size_t(std::ceil((sample.segments + runs / 2.) / (runs * run_span) * n));
+        return {count, sample.segments < min_segments ? "fit" : "sampled"};
+    };
+
+    std::vector<IndexEstimate> estimates;
+    std::vector<IndexStats> fit_points;
+    std::vector<double> ns_per_key;
+
+    for (auto epsilon : epsilons) {
+        IndexEstimate estimate{epsilon, 0, 0, 0, 0, "exact"};
+        ns_per_key.push_back(0);
+        if (n > 0) {
+            auto timed_keys = std::min(n, std::max<size_t>(m / 4, 1u << 14));
+            SampleSegmentation<K> timed(data, epsilon);
+            auto ns = std::numeric_limits<double>::max();
+            for (auto repetition = 0; repetition < 2; ++repetition) { // The first one also loads the block in cache
+                auto start = timer::now();
+                timed.add_run((n - timed_keys) / 2, timed_keys, 1);
+                auto end = timer::now();
+                ns = std::min<double>(ns, std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+            }
+            ns_per_key.back() = ns / timed_keys;
+            std::tie(estimate.segments_count, estimate.method) = sample_segments(epsilon, m);
+        }
+
+        if (std::strcmp(estimate.method, "fit") != 0 && estimate.segments_count >= min_segments) {
+            fit_points.emplace_back();
+            fit_points.back().epsilon = epsilon;
+            fit_points.back().segments_count = estimate.segments_count;
+        }
+        estimates.push_back(estimate);
+    }
+
+    std::sort(fit_points.begin(), fit_points.end(), [](auto &a, auto &b) { return a.epsilon < b.epsilon; });
+    auto distinct = std::unique(fit_points.begin(), fit_points.end(), [](auto &a, auto &b) {
+        return a.epsilon == b.epsilon;
+    });
+    fit_points.erase(distinct, fit_points.end());
+    auto can_fit = fit_points.size() >= 2;
+    auto[a, b] = can_fit ? fit_segments_count_model(fit_points) : std::make_pair(0., 0.);
+
+    auto segment_bytes = sizeof(typename pgm::PGMIndex<K, 1, PGM_EPSILON_RECURSIVE, Floating>::Segment);
+    for (size_t i = 0; i < estimates.size(); ++i) {
+        auto &estimate = estimates[i];
+        if (std::strcmp(estimate.method, "fit") == 0 && can_fit)
+            estimate.segments_count = std::max<size_t>(1, size_t(std::round(a * std::pow(estimate.epsilon, b))));
+        else if (std::strcmp(estimate.method, "fit") == 0)
+            estimate.method = "sampled";
+        if (n == 0)
+            continue;
+
+        // The first keys of a level are about one every n/level_size positions, and each level ends with a sentinel
+        auto level_size = estimate.segments_count;
+        auto upper_keys = 0.;
+        estimate.height = 1;
+        estimate.bytes = (level_size + 1) * segment_bytes;
+        while (epsilon_recursive && level_size > 1) {
+            upper_keys += level_size;
+            auto upper_epsilon = epsilon_recursive * std::max<size_t>(1, n / level_size);
+            auto next_size = sample_segments(upper_epsilon, std::max(m / 4, std::min<size_t>(m, 4096))).first;
+            level_size = std::clamp<size_t>(next_size, 1, level_size - 1);
+            estimate.bytes += (level_size + 1) * segment_bytes;
+            ++estimate.height;
+        }
+        estimate.bytes += (estimate.height + 1) * sizeof(size_t);
+        estimate.construction_ns = size_t(ns_per_key[i] * (n + upper_keys));
+    }
+
+    return estimates;
+}
+
 /*------- ROOT FINDING -------*/
 
 double target_space_function(double epsilon, double a, double b, double max_space, double constants) {